@@ -0,0 +1,226 @@
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include "checkpoint.h"
+#include "content_hash.h"
+#include "photon_cache.h"
+
+namespace {
+
+// bump when the file layout changes
+const uint32_t CHECKPOINT_VERSION = 2u;
+const char CHECKPOINT_MAGIC[8] = { 'R','A','Y','C','K','P','T','\0' };
+
+/* The file is this header, then the buffer's arrays as they are held in
+   memory, then the gather points field by field.
+*/
+struct checkpoint_header {
+  char magic[8];
+  uint32_t version;
+  uint32_t passes_done;
+  uint32_t width;
+  uint32_t height;
+  uint64_t key;
+  uint64_t gather_point_count;
+};
+
+typedef std::unique_ptr<FILE,int(*)(FILE*)> unique_file_ptr;
+
+int null_friendly_fclose(FILE* file) {
+  if (!file) {
+    return 0;
+  }
+  fclose(file);
+  return 0;
+}
+
+void add_material(content_hash& hash, const material_t& material) {
+  hash.add(material.color);
+  hash.add(material.secondary_color);
+  hash.add(material.k_flat);
+  hash.add(material.k_ambient);
+  hash.add(material.k_specular);
+  hash.add(material.k_specular_n);
+  hash.add(material.k_matte);
+  hash.add(material.reflectivity);
+}
+
+template<class T>
+bool write_array(FILE* file, const std::vector<T>& values) {
+  return values.empty() ||
+    fwrite(values.data(), sizeof(T), values.size(), file) == values.size();
+}
+
+template<class T>
+bool read_array(FILE* file, std::vector<T>& values) {
+  return values.empty() ||
+    fread(values.data(), sizeof(T), values.size(), file) == values.size();
+}
+
+template<class T>
+bool write_value(FILE* file, const T& value) {
+  return fwrite(&value, sizeof(T), 1u, file) == 1u;
+}
+
+template<class T>
+bool read_value(FILE* file, T& value) {
+  return fread(&value, sizeof(T), 1u, file) == 1u;
+}
+
+/* Each point's fields are written in fixed widths one after another, so
+   the file holds none of the struct's padding.
+*/
+bool write_gather_points(FILE* file, const std::vector<gather_point>& points) {
+  for (const gather_point& point : points) {
+    if (!write_value(file, point.position) ||
+        !write_value(file, point.normal) ||
+        !write_value(file, point.weight) ||
+        !write_value(file, uint32_t(point.pixel)) ||
+        !write_value(file, uint8_t(point.on_mesh)) ||
+        !write_value(file, uint64_t(point.obj_idx)) ||
+        !write_value(file, point.radius_sq) ||
+        !write_value(file, point.photon_count) ||
+        !write_value(file, point.flux)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool read_gather_points(FILE* file, std::vector<gather_point>& points) {
+  for (gather_point& point : points) {
+    uint32_t pixel;
+    uint8_t on_mesh;
+    uint64_t obj_idx;
+    if (!read_value(file, point.position) ||
+        !read_value(file, point.normal) ||
+        !read_value(file, point.weight) ||
+        !read_value(file, pixel) ||
+        !read_value(file, on_mesh) ||
+        !read_value(file, obj_idx) ||
+        !read_value(file, point.radius_sq) ||
+        !read_value(file, point.photon_count) ||
+        !read_value(file, point.flux)) {
+      return false;
+    }
+    point.pixel = pixel;
+    point.on_mesh = on_mesh != 0u;
+    point.obj_idx = size_t(obj_idx);
+  }
+  return true;
+}
+
+} // namespace
+
+uint64_t render_key(const scene_t& s, unsigned tile_size) {
+  content_hash hash;
+  hash.add(CHECKPOINT_VERSION);
+  // the photon map key covers the geometry, transparency and lights
+  hash.add(photon_map_key(s));
+  hash.add(s.res.x);
+  hash.add(s.res.y);
+  hash.add(s.crop.x0);
+  hash.add(s.crop.y0);
+  hash.add(s.crop.x1);
+  hash.add(s.crop.y1);
+  hash.add(s.sample_count);
+  hash.add(s.min_sample_count);
+  hash.add(s.noise_threshold);
+  hash.add(uint32_t(s.integrator));
+  hash.add(s.photon_radius);
+  hash.add(s.photon_neighbors);
+  hash.add(s.photon_passes);
+  hash.add(s.irradiance_error);
+  hash.add(s.roulette_depth);
+  hash.add(s.min_ray_weight);
+  hash.add(s.stochastic_branching);
+  hash.add(s.ambient_light);
+  hash.add(s.camera.observer);
+  hash.add(s.camera.screen_top_left);
+  hash.add(s.camera.screen_top_right);
+  hash.add(s.camera.screen_bottom_right);
+  for (const material_t& material : s.sphere_materials) {
+    add_material(hash, material);
+  }
+  for (const material_t& material : s.mesh_materials) {
+    add_material(hash, material);
+  }
+  for (const light_t& light : s.lights) {
+    hash.add(light.color);
+  }
+  hash.add(tile_size);
+  return hash.value();
+}
+
+bool save_checkpoint(const char* file, uint64_t key, unsigned passes_done,
+  const accumulation_buffer& buffer,
+  const std::vector<gather_point>* gather_points)
+{
+  // write beside the destination, so a kill mid-write leaves the last one
+  std::string temporary = std::string(file) + ".tmp";
+  unique_file_ptr fp(fopen(temporary.c_str(), "wb"), &null_friendly_fclose);
+  if (!fp) {
+    return false;
+  }
+
+  checkpoint_header header;
+  memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic));
+  header.version = CHECKPOINT_VERSION;
+  header.passes_done = passes_done;
+  header.width = buffer.width();
+  header.height = buffer.height();
+  header.key = key;
+  header.gather_point_count = gather_points ? gather_points->size() : 0u;
+
+  bool ok = fwrite(&header, sizeof(header), 1u, fp.get()) == 1u &&
+    write_array(fp.get(), buffer.light) &&
+    write_array(fp.get(), buffer.sample_counts) &&
+    write_array(fp.get(), buffer.brightness_sums) &&
+    write_array(fp.get(), buffer.brightness_sums_sq);
+  if (gather_points) {
+    ok = ok && write_gather_points(fp.get(), *gather_points);
+  }
+  ok = fflush(fp.get()) == 0 && ok;
+  fp.reset();
+
+  if (!ok || rename(temporary.c_str(), file) != 0) {
+    remove(temporary.c_str());
+    return false;
+  }
+  return true;
+}
+
+bool load_checkpoint(const char* file, uint64_t key, unsigned& passes_done,
+  accumulation_buffer& buffer, std::vector<gather_point>* gather_points)
+{
+  unique_file_ptr fp(fopen(file, "rb"), &null_friendly_fclose);
+  if (!fp) {
+    return false;
+  }
+  checkpoint_header header;
+  if (fread(&header, sizeof(header), 1u, fp.get()) != 1u ||
+      memcmp(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic)) != 0 ||
+      header.version != CHECKPOINT_VERSION || header.key != key ||
+      header.width != buffer.width() || header.height != buffer.height() ||
+      (header.gather_point_count > 0u && !gather_points)) {
+    return false;
+  }
+
+  accumulation_buffer loaded(header.width, header.height);
+  std::vector<gather_point> loaded_points(header.gather_point_count);
+  if (!read_array(fp.get(), loaded.light) ||
+      !read_array(fp.get(), loaded.sample_counts) ||
+      !read_array(fp.get(), loaded.brightness_sums) ||
+      !read_array(fp.get(), loaded.brightness_sums_sq) ||
+      !read_gather_points(fp.get(), loaded_points)) {
+    return false;
+  }
+
+  passes_done = header.passes_done;
+  buffer = std::move(loaded);
+  if (gather_points) {
+    *gather_points = std::move(loaded_points);
+  }
+  return true;
+}
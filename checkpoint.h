@@ -0,0 +1,32 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <cstdint>
+#include <vector>
+#include "image.h"
+#include "photon_map.h"
+#include "scene.h"
+
+/* A hash of everything that changes the samples a render takes: the
+   scene, its render settings, and the tile size, which decides how
+   samples are split between tasks and so the order they're summed in.
+*/
+uint64_t render_key(const scene_t& s, unsigned tile_size);
+
+/* Saves a render stopped between passes: how many passes are done, the
+   accumulation buffer, and for progressive photon mapping, the gather
+   points recorded so far. Nothing else is needed to continue, since each
+   sample seeds its random numbers from its pixel and index.
+*/
+bool save_checkpoint(const char* file, uint64_t key, unsigned passes_done,
+  const accumulation_buffer& buffer,
+  const std::vector<gather_point>* gather_points);
+
+/* Loads a checkpoint saved with the same key and image size. Returns
+   false, leaving the arguments untouched, if the file is missing or was
+   saved for a different render.
+*/
+bool load_checkpoint(const char* file, uint64_t key, unsigned& passes_done,
+  accumulation_buffer& buffer, std::vector<gather_point>* gather_points);
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef CONTENT_HASH_H
+#define CONTENT_HASH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/* A 64-bit FNV-1a hash of the bytes of the values added to it, for
+   recognizing files saved from the same inputs.
+*/
+class content_hash {
+public:
+  content_hash() : hash_(14695981039346656037ull) {
+  }
+
+  void add_bytes(const void* data, size_t size) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0u; i < size; ++i) {
+      hash_ ^= bytes[i];
+      hash_ *= 1099511628211ull;
+    }
+  }
+
+  template<class T>
+  void add(const T& value) {
+    add_bytes(&value, sizeof(value));
+  }
+
+  template<class T>
+  void add(const std::vector<T>& values) {
+    add(uint64_t(values.size()));
+    add_bytes(values.data(), values.size() * sizeof(T));
+  }
+
+  void add(const std::vector<bool>& values) {
+    add(uint64_t(values.size()));
+    for (bool value : values) {
+      add(value);
+    }
+  }
+
+  uint64_t value() const {
+    return hash_;
+  }
+
+private:
+  uint64_t hash_;
+};
+
+#endif
@@ -0,0 +1,620 @@
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <thread>
+#include <dirent.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "checkpoint.h"
+#include "distributed.h"
+#include "scheduler.h"
+
+namespace {
+
+// bump when the result layout changes
+const uint32_t JOB_RESULT_VERSION = 1u;
+const char JOB_RESULT_MAGIC[8] = { 'R','A','Y','J','O','B','\0','\0' };
+
+// how often queue workers and coordinators look for new files
+const std::chrono::milliseconds QUEUE_POLL_INTERVAL(100);
+
+/* A job's result is this header, then the buffer's arrays for its window,
+   row by row, then its gather points.
+*/
+struct job_result_header {
+  char magic[8];
+  uint32_t version;
+  uint32_t job;
+  uint64_t key;
+  crop_t window;
+  uint64_t gather_point_count;
+};
+
+typedef std::unique_ptr<FILE,int(*)(FILE*)> unique_file_ptr;
+
+int null_friendly_fclose(FILE* file) {
+  if (!file) {
+    return 0;
+  }
+  fclose(file);
+  return 0;
+}
+
+/* The key of the render the jobs belong to. Every job renders a different
+   crop of the same render, so the crop is left out.
+*/
+uint64_t job_key(const scene_t& s, unsigned tile_size) {
+  scene_t whole = s;
+  whole.crop = { 0u, 0u, s.res.x, s.res.y };
+  return render_key(whole, tile_size);
+}
+
+// the job windows, in Hilbert order over the scene's crop
+std::vector<crop_t> job_windows(const scene_t& s, unsigned job_size) {
+  std::vector<crop_t> windows;
+  for (const tile_t& tile : hilbert_tiles(s.crop.width(), s.crop.height(),
+    job_size))
+  {
+    crop_t window = { s.crop.x0 + tile.x0, s.crop.y0 + tile.y0,
+      s.crop.x0 + tile.x1, s.crop.y0 + tile.y1 };
+    windows.push_back(window);
+  }
+  return windows;
+}
+
+bool same_window(const crop_t& lhs, const crop_t& rhs) {
+  return lhs.x0 == rhs.x0 && lhs.y0 == rhs.y0 && lhs.x1 == rhs.x1 &&
+    lhs.y1 == rhs.y1;
+}
+
+template<class T>
+bool write_window(FILE* file, const std::vector<T>& values, unsigned width,
+  const crop_t& window)
+{
+  for (unsigned y = window.y0; y < window.y1; ++y) {
+    if (fwrite(values.data() + size_t(y) * width + window.x0, sizeof(T),
+      window.width(), file) != window.width())
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+template<class T>
+bool read_window(FILE* file, std::vector<T>& values, unsigned width,
+  const crop_t& window)
+{
+  for (unsigned y = window.y0; y < window.y1; ++y) {
+    if (fread(values.data() + size_t(y) * width + window.x0, sizeof(T),
+      window.width(), file) != window.width())
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool write_job_result(FILE* file, uint64_t key, unsigned job,
+  const crop_t& window, const accumulation_buffer& buffer,
+  const std::vector<gather_point>& gather_points)
+{
+  job_result_header header;
+  memcpy(header.magic, JOB_RESULT_MAGIC, sizeof(header.magic));
+  header.version = JOB_RESULT_VERSION;
+  header.job = job;
+  header.key = key;
+  header.window = window;
+  header.gather_point_count = gather_points.size();
+
+  unsigned width = buffer.width();
+  bool ok = fwrite(&header, sizeof(header), 1u, file) == 1u &&
+    write_window(file, buffer.light, width, window) &&
+    write_window(file, buffer.sample_counts, width, window) &&
+    write_window(file, buffer.brightness_sums, width, window) &&
+    write_window(file, buffer.brightness_sums_sq, width, window) &&
+    (gather_points.empty() || fwrite(gather_points.data(),
+      sizeof(gather_point), gather_points.size(), file) ==
+      gather_points.size());
+  return fflush(file) == 0 && ok;
+}
+
+/* Reads the result of the given job into its window of the buffer, which
+   nothing else writes to, and its gather points.
+*/
+bool read_job_result(FILE* file, uint64_t key, unsigned job,
+  const crop_t& window, accumulation_buffer& buffer,
+  std::vector<gather_point>& gather_points)
+{
+  job_result_header header;
+  if (fread(&header, sizeof(header), 1u, file) != 1u ||
+    memcmp(header.magic, JOB_RESULT_MAGIC, sizeof(header.magic)) != 0 ||
+    header.version != JOB_RESULT_VERSION || header.key != key ||
+    header.job != job || !same_window(header.window, window))
+  {
+    return false;
+  }
+  unsigned width = buffer.width();
+  gather_points.resize(header.gather_point_count);
+  return read_window(file, buffer.light, width, window) &&
+    read_window(file, buffer.sample_counts, width, window) &&
+    read_window(file, buffer.brightness_sums, width, window) &&
+    read_window(file, buffer.brightness_sums_sq, width, window) &&
+    (gather_points.empty() || fread(gather_points.data(),
+      sizeof(gather_point), gather_points.size(), file) ==
+      gather_points.size());
+}
+
+/* Renders a window into the buffer, which must be clear there, as a crop
+   of the scene.
+*/
+void render_window(scene_t& s, const render_options& options,
+  thread_pool& pool, const crop_t& window, accumulation_buffer& buffer,
+  std::vector<gather_point>& gather_points)
+{
+  s.crop = window;
+  gather_points.clear();
+  bool gathers_photons = s.integrator == PROGRESSIVE_PHOTON_INTEGRATOR;
+  render_image(s, options, pool, buffer, gathers_photons ? &gather_points : 0);
+}
+
+void clear_window(accumulation_buffer& buffer, const crop_t& window) {
+  for (unsigned y = window.y0; y < window.y1; ++y) {
+    size_t first = size_t(y) * buffer.width() + window.x0;
+    size_t last = first + window.width();
+    std::fill(buffer.light.begin() + first, buffer.light.begin() + last,
+      vec3f(0,0,0));
+    std::fill(buffer.sample_counts.begin() + first,
+      buffer.sample_counts.begin() + last, 0u);
+    std::fill(buffer.brightness_sums.begin() + first,
+      buffer.brightness_sums.begin() + last, 0.f);
+    std::fill(buffer.brightness_sums_sq.begin() + first,
+      buffer.brightness_sums_sq.begin() + last, 0.f);
+  }
+}
+
+/* A worker process started by the coordinator, reading jobs from its
+   standard input and writing results to its standard output.
+*/
+struct local_worker {
+  local_worker()
+    : pid(-1)
+    , jobs(0)
+    , results(0)
+    , job(-1)
+  {
+  }
+
+  pid_t pid;
+  FILE* jobs;
+  FILE* results;
+  long job; // the job it's rendering, or -1
+};
+
+/* Starts the worker command with the extra arguments. Returns a worker
+   with no pid if it couldn't.
+*/
+local_worker start_worker(const std::vector<std::string>& command,
+  const std::vector<std::string>& extra_args)
+{
+  local_worker worker;
+  int to_worker[2];
+  int from_worker[2];
+  if (pipe(to_worker) != 0) {
+    return worker;
+  }
+  if (pipe(from_worker) != 0) {
+    close(to_worker[0]);
+    close(to_worker[1]);
+    return worker;
+  }
+  // only the duplicates made in the child should survive exec
+  const int fds[] = { to_worker[0], to_worker[1], from_worker[0],
+    from_worker[1] };
+  for (int fd : fds) {
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+  }
+
+  std::vector<std::string> args = command;
+  args.insert(args.end(), extra_args.begin(), extra_args.end());
+  std::vector<char*> argv;
+  for (std::string& arg : args) {
+    argv.push_back(&arg[0]);
+  }
+  argv.push_back(0);
+
+  worker.pid = fork();
+  if (worker.pid == 0) {
+    dup2(to_worker[0], STDIN_FILENO);
+    dup2(from_worker[1], STDOUT_FILENO);
+    execv(argv[0], argv.data());
+    _exit(127);
+  }
+  close(to_worker[0]);
+  close(from_worker[1]);
+  if (worker.pid < 0) {
+    close(to_worker[1]);
+    close(from_worker[0]);
+    return worker;
+  }
+  worker.jobs = fdopen(to_worker[1], "w");
+  worker.results = fdopen(from_worker[0], "r");
+  return worker;
+}
+
+// closes the worker's input, so it finishes, and waits for it to exit
+void stop_worker(local_worker& worker) {
+  if (worker.pid < 0) {
+    return;
+  }
+  null_friendly_fclose(worker.jobs);
+  null_friendly_fclose(worker.results);
+  int status;
+  waitpid(worker.pid, &status, 0);
+  worker = local_worker();
+}
+
+// whether the worker is still running, reaping it if it has exited
+bool worker_running(local_worker& worker) {
+  if (worker.pid < 0) {
+    return false;
+  }
+  int status;
+  if (waitpid(worker.pid, &status, WNOHANG) == 0) {
+    return true;
+  }
+  null_friendly_fclose(worker.jobs);
+  null_friendly_fclose(worker.results);
+  worker = local_worker();
+  return false;
+}
+
+bool send_job(local_worker& worker, size_t job, const crop_t& window) {
+  worker.job = long(job);
+  return fprintf(worker.jobs, "%u %u %u %u %u\n", unsigned(job), window.x0,
+    window.y0, window.x1, window.y1) > 0 && fflush(worker.jobs) == 0;
+}
+
+/* Hands jobs out to local workers over pipes, one at a time each, as
+   they finish their last. A job whose worker dies goes to another.
+*/
+bool render_on_local_workers(const std::vector<crop_t>& windows,
+  uint64_t key, const distributed_options& distributed,
+  accumulation_buffer& buffer,
+  std::vector<std::vector<gather_point>>& job_points)
+{
+  std::vector<local_worker> workers;
+  for (unsigned i = 0u; i < distributed.worker_count; ++i) {
+    local_worker worker = start_worker(distributed.worker_command,
+      std::vector<std::string>(1u, "--worker"));
+    if (worker.pid >= 0) {
+      workers.push_back(worker);
+    }
+  }
+
+  std::deque<size_t> pending;
+  for (size_t job = 0u; job < windows.size(); ++job) {
+    pending.push_back(job);
+  }
+  size_t finished = 0u;
+  while (finished < windows.size()) {
+    for (local_worker& worker : workers) {
+      if (worker.pid >= 0 && worker.job < 0 && !pending.empty()) {
+        size_t job = pending.front();
+        pending.pop_front();
+        if (!send_job(worker, job, windows[job])) {
+          pending.push_front(job);
+          stop_worker(worker);
+        }
+      }
+    }
+
+    std::vector<pollfd> polled;
+    std::vector<local_worker*> busy;
+    for (local_worker& worker : workers) {
+      if (worker.pid >= 0 && worker.job >= 0) {
+        pollfd fd = { fileno(worker.results), POLLIN, 0 };
+        polled.push_back(fd);
+        busy.push_back(&worker);
+      }
+    }
+    if (polled.empty()) {
+      break; // every worker has died
+    }
+    if (poll(polled.data(), polled.size(), -1) < 0) {
+      if (errno == EINTR) {
+        continue; // interrupted by a signal
+      }
+      std::cerr << "Failed to wait for workers: " << strerror(errno)
+        << std::endl;
+      break;
+    }
+
+    for (size_t i = 0u; i < polled.size(); ++i) {
+      if (!polled[i].revents) {
+        continue;
+      }
+      local_worker& worker = *busy[i];
+      size_t job = size_t(worker.job);
+      if (read_job_result(worker.results, key, unsigned(job), windows[job],
+        buffer, job_points[job]))
+      {
+        worker.job = -1;
+        ++finished;
+      } else {
+        std::cerr << "Worker " << worker.pid << " failed on job " << job
+          << std::endl;
+        clear_window(buffer, windows[job]);
+        pending.push_front(job);
+        stop_worker(worker);
+      }
+    }
+  }
+
+  for (local_worker& worker : workers) {
+    stop_worker(worker);
+  }
+  return finished == windows.size();
+}
+
+std::string queue_path(const char* dir, const std::string& name) {
+  return std::string(dir) + "/" + name;
+}
+
+std::string job_name(size_t job) {
+  std::ostringstream name;
+  name << "job-" << job;
+  return name.str();
+}
+
+bool file_exists(const std::string& path) {
+  struct stat info;
+  return stat(path.c_str(), &info) == 0;
+}
+
+// the names of the files in the directory that start with prefix
+std::vector<std::string> files_starting(const char* dir,
+  const std::string& prefix)
+{
+  std::vector<std::string> names;
+  DIR* listing = opendir(dir);
+  if (!listing) {
+    return names;
+  }
+  while (dirent* entry = readdir(listing)) {
+    std::string name = entry->d_name;
+    if (name.compare(0, prefix.size(), prefix) == 0) {
+      names.push_back(name);
+    }
+  }
+  closedir(listing);
+  std::sort(names.begin(), names.end());
+  return names;
+}
+
+// writes the file beside its destination first, so it appears complete
+bool publish_file(const std::string& path, const std::string& contents) {
+  std::string temporary = path + ".tmp";
+  {
+    std::ofstream file(temporary.c_str());
+    file << contents;
+    if (!file.flush()) {
+      return false;
+    }
+  }
+  return rename(temporary.c_str(), path.c_str()) == 0;
+}
+
+/* Publishes every job to the queue directory as a .todo file, then
+   collects the .result files workers leave in their place, marking the
+   queue done once all are in. If it started workers, it gives up once
+   they have all exited.
+*/
+bool render_on_queue(const std::vector<crop_t>& windows, uint64_t key,
+  const distributed_options& distributed, accumulation_buffer& buffer,
+  std::vector<std::vector<gather_point>>& job_points)
+{
+  const char* dir = distributed.queue_dir;
+  mkdir(dir, 0777);
+  for (const std::string& name : files_starting(dir, "job-")) {
+    remove(queue_path(dir, name).c_str());
+  }
+  remove(queue_path(dir, "done").c_str());
+
+  for (size_t job = 0u; job < windows.size(); ++job) {
+    const crop_t& window = windows[job];
+    std::ostringstream contents;
+    contents << key << " " << job << " " << window.x0 << " " << window.y0
+      << " " << window.x1 << " " << window.y1 << "\n";
+    if (!publish_file(queue_path(dir, job_name(job) + ".todo"),
+      contents.str()))
+    {
+      std::cerr << "Failed to add jobs to " << dir << std::endl;
+      return false;
+    }
+  }
+
+  std::vector<std::string> extra_args;
+  extra_args.push_back("--serve-queue");
+  extra_args.push_back(dir);
+  std::vector<local_worker> workers;
+  for (unsigned i = 0u; i < distributed.worker_count; ++i) {
+    local_worker worker = start_worker(distributed.worker_command,
+      extra_args);
+    if (worker.pid >= 0) {
+      workers.push_back(worker);
+    }
+  }
+
+  std::vector<bool> collected(windows.size(), false);
+  size_t finished = 0u;
+  bool ok = true;
+  while (ok && finished < windows.size()) {
+    // reaped before looking, so the results of the last to exit are seen
+    bool running = false;
+    for (local_worker& worker : workers) {
+      running = worker_running(worker) || running;
+    }
+    bool found = false;
+    for (size_t job = 0u; job < windows.size(); ++job) {
+      std::string path = queue_path(dir, job_name(job) + ".result");
+      if (collected[job] || !file_exists(path)) {
+        continue;
+      }
+      unique_file_ptr fp(fopen(path.c_str(), "rb"), &null_friendly_fclose);
+      if (!fp || !read_job_result(fp.get(), key, unsigned(job), windows[job],
+        buffer, job_points[job]))
+      {
+        std::cerr << "Failed to read " << path << std::endl;
+        ok = false;
+        break;
+      }
+      fp.reset();
+      remove(path.c_str());
+      collected[job] = true;
+      ++finished;
+      found = true;
+    }
+    if (!found && ok && finished < windows.size()) {
+      if (distributed.worker_count > 0u && !running) {
+        std::cerr << "Every worker serving " << dir << " has exited"
+          << std::endl;
+        ok = false;
+        break;
+      }
+      std::this_thread::sleep_for(QUEUE_POLL_INTERVAL);
+    }
+  }
+
+  publish_file(queue_path(dir, "done"), "");
+  for (local_worker& worker : workers) {
+    stop_worker(worker);
+  }
+  return ok;
+}
+
+} // namespace
+
+bool render_distributed(const scene_t& s, const render_options& options,
+  const distributed_options& distributed, accumulation_buffer& buffer,
+  std::vector<gather_point>* gather_points)
+{
+  // a worker dying mid-job shouldn't take the coordinator with it
+  std::signal(SIGPIPE, SIG_IGN);
+  const uint64_t key = job_key(s, options.tile_size);
+  const std::vector<crop_t> windows = job_windows(s, distributed.job_size);
+  std::vector<std::vector<gather_point>> job_points(windows.size());
+  bool ok = distributed.queue_dir ?
+    render_on_queue(windows, key, distributed, buffer, job_points) :
+    render_on_local_workers(windows, key, distributed, buffer, job_points);
+  if (ok && gather_points) {
+    for (const auto& points : job_points) {
+      gather_points->insert(gather_points->end(), points.begin(),
+        points.end());
+    }
+  }
+  return ok;
+}
+
+bool serve_pipe_jobs(scene_t s, const render_options& options,
+  thread_pool& pool, FILE* jobs, FILE* results)
+{
+  const uint64_t key = job_key(s, options.tile_size);
+  accumulation_buffer buffer(s.res.x, s.res.y);
+  std::vector<gather_point> gather_points;
+  unsigned job;
+  crop_t window;
+  while (fscanf(jobs, "%u %u %u %u %u", &job, &window.x0, &window.y0,
+    &window.x1, &window.y1) == 5)
+  {
+    if (!window.fits(s.res)) {
+      return false;
+    }
+    render_window(s, options, pool, window, buffer, gather_points);
+    if (!write_job_result(results, key, job, window, buffer, gather_points)) {
+      return false;
+    }
+    clear_window(buffer, window);
+  }
+  return true;
+}
+
+bool serve_job_queue(scene_t s, const render_options& options,
+  thread_pool& pool, const char* dir)
+{
+  const uint64_t key = job_key(s, options.tile_size);
+  accumulation_buffer buffer(s.res.x, s.res.y);
+  std::vector<gather_point> gather_points;
+
+  char host[256] = "";
+  gethostname(host, sizeof(host) - 1u);
+  std::ostringstream claimant;
+  claimant << host << "-" << getpid();
+
+  while (!file_exists(queue_path(dir, "done"))) {
+    bool claimed = false;
+    for (const std::string& name : files_starting(dir, "job-")) {
+      const std::string todo_suffix = ".todo";
+      if (name.size() <= todo_suffix.size() || name.compare(
+        name.size() - todo_suffix.size(), todo_suffix.size(), todo_suffix))
+      {
+        continue;
+      }
+      // renaming is atomic, so only one worker can claim each job
+      std::string job_file = name.substr(0, name.size() - todo_suffix.size());
+      std::string todo = queue_path(dir, name);
+      std::string claim = queue_path(dir, job_file + ".claimed." +
+        claimant.str());
+      if (rename(todo.c_str(), claim.c_str()) != 0) {
+        continue;
+      }
+
+      std::ifstream file(claim.c_str());
+      uint64_t job_key_read;
+      unsigned job;
+      crop_t window;
+      if (!(file >> job_key_read >> job >> window.x0 >> window.y0 >>
+        window.x1 >> window.y1) || job_key_read != key ||
+        !window.fits(s.res))
+      {
+        // leave it for a worker on the right render
+        rename(claim.c_str(), todo.c_str());
+        std::cerr << "The jobs in " << dir << " are for a different scene "
+          << "or settings" << std::endl;
+        return false;
+      }
+
+      render_window(s, options, pool, window, buffer, gather_points);
+      std::string result = queue_path(dir, job_file + ".result");
+      std::string temporary = result + "." + claimant.str() + ".tmp";
+      unique_file_ptr fp(fopen(temporary.c_str(), "wb"),
+        &null_friendly_fclose);
+      bool written = fp && write_job_result(fp.get(), key, job, window,
+        buffer, gather_points);
+      fp.reset();
+      clear_window(buffer, window);
+      if (!written || rename(temporary.c_str(), result.c_str()) != 0) {
+        remove(temporary.c_str());
+        rename(claim.c_str(), todo.c_str());
+        return false;
+      }
+      remove(claim.c_str());
+      claimed = true;
+      break;
+    }
+    if (!claimed) {
+      std::this_thread::sleep_for(QUEUE_POLL_INTERVAL);
+    }
+  }
+  return true;
+}
@@ -0,0 +1,54 @@
+#ifndef DISTRIBUTED_H
+#define DISTRIBUTED_H
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "image.h"
+#include "photon_map.h"
+#include "render.h"
+#include "scene.h"
+#include "thread_pool.h"
+
+/* How a coordinator shares a render out. Each job is a window of the
+   image, rendered by a worker as a crop. Jobs go to worker_count local
+   processes over pipes, or with a queue directory, to any process serving
+   it, including ones on other machines that share the directory.
+*/
+struct distributed_options {
+  distributed_options()
+    : worker_count(0u)
+    , queue_dir(0)
+    , job_size(128u)
+  {
+  }
+
+  unsigned worker_count; // local worker processes to start
+  const char* queue_dir; // if set, jobs are shared through this directory
+  unsigned job_size; // the width and height of each job's window
+  // the program and arguments that start a worker on the same render
+  std::vector<std::string> worker_command;
+};
+
+/* Renders the scene's crop as jobs on workers, adding their results to
+   the buffer and their gather points to gather_points, in job order. A
+   window renders exactly as the same pixels of a full render, so the
+   image matches a single process's. Returns false if the workers fail.
+*/
+bool render_distributed(const scene_t& s, const render_options& options,
+  const distributed_options& distributed, accumulation_buffer& buffer,
+  std::vector<gather_point>* gather_points);
+
+/* Renders the jobs read from the coordinator, one per line, writing each
+   one's result back, until the coordinator closes jobs.
+*/
+bool serve_pipe_jobs(scene_t s, const render_options& options,
+  thread_pool& pool, FILE* jobs, FILE* results);
+
+/* Claims and renders jobs from a queue directory until the coordinator
+   marks it done. Returns false if the jobs are for a different render.
+*/
+bool serve_job_queue(scene_t s, const render_options& options,
+  thread_pool& pool, const char* dir);
+
+#endif
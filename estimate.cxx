@@ -0,0 +1,137 @@
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <ostream>
+#include <unistd.h>
+#include "estimate.h"
+
+namespace {
+
+const char* const RAY_KIND_NAMES[RAY_KIND_COUNT] = {
+  "camera",
+  "secondary",
+  "shadow",
+  "photon_gather",
+};
+
+// the string as a JSON string, quoted and escaped
+std::string json_string(const std::string& value) {
+  std::string quoted = "\"";
+  for (char c : value) {
+    if (c == '"' || c == '\\') {
+      quoted += '\\';
+      quoted += c;
+    } else if (static_cast<unsigned char>(c) < 0x20u) {
+      char escaped[8];
+      std::snprintf(escaped, sizeof(escaped), "\\u%04x", unsigned(c));
+      quoted += escaped;
+    } else {
+      quoted += c;
+    }
+  }
+  return quoted + "\"";
+}
+
+// how many times more pixels the render takes than the sample did
+double sample_scale(const camera_estimate& camera) {
+  return camera.sample.pixel_count ?
+    double(camera.pixel_count) / camera.sample.pixel_count : 0.;
+}
+
+// the seconds a kind of ray took in the sample, as if from the full map
+double ray_seconds(const camera_estimate& camera, unsigned kind) {
+  double seconds = camera.sample.rays.seconds[kind];
+  return kind == PHOTON_GATHER ? seconds * camera.gather_scale : seconds;
+}
+
+double render_seconds(const camera_estimate& camera, unsigned thread_count) {
+  double sample_seconds = camera.sample.seconds +
+    ray_seconds(camera, PHOTON_GATHER) -
+    camera.sample.rays.seconds[PHOTON_GATHER];
+  return sample_seconds * sample_scale(camera) / std::max(thread_count, 1u);
+}
+
+double camera_seconds(const camera_estimate& camera, unsigned thread_count) {
+  return camera.irradiance_seconds + camera.photon_passes *
+    camera.photon_pass_seconds + render_seconds(camera, thread_count);
+}
+
+size_t camera_bytes(const camera_estimate& camera) {
+  // the points each task recorded, and all of them together
+  size_t gather_points = size_t(camera.gather_point_count *
+    sample_scale(camera) + 0.5);
+  return camera.buffer_bytes + 2u * gather_points * sizeof(gather_point);
+}
+
+void write_camera(const camera_estimate& camera, unsigned thread_count,
+  std::ostream& out)
+{
+  const render_sample& sample = camera.sample;
+  double pixels = std::max<double>(sample.pixel_count, 1.);
+  out << "    {\n"
+    << "      \"name\": " << json_string(camera.name) << ",\n"
+    << "      \"pixels\": " << camera.pixel_count << ",\n"
+    << "      \"sampled_pixels\": " << sample.pixel_count << ",\n"
+    << "      \"samples_per_pixel\": " << sample.sample_count / pixels
+    << ",\n"
+    << "      \"rays\": {\n";
+  for (unsigned kind = 0u; kind < RAY_KIND_COUNT; ++kind) {
+    size_t count = sample.rays.counts[kind];
+    double seconds = ray_seconds(camera, kind);
+    out << "        " << json_string(RAY_KIND_NAMES[kind]) << ": {"
+      << " \"per_pixel\": " << count / pixels << ","
+      << " \"seconds_per_ray\": " << (count ? seconds / count : 0.) << ","
+      << " \"seconds\": " << seconds * sample_scale(camera) /
+        std::max(thread_count, 1u) << " }"
+      << (kind + 1u < RAY_KIND_COUNT ? "," : "") << "\n";
+  }
+  out << "      },\n"
+    << "      \"irradiance_seconds\": " << camera.irradiance_seconds << ",\n"
+    << "      \"photon_pass_seconds\": " << camera.photon_passes *
+      camera.photon_pass_seconds << ",\n"
+    << "      \"render_seconds\": " << render_seconds(camera, thread_count)
+    << ",\n"
+    << "      \"seconds\": " << camera_seconds(camera, thread_count) << ",\n"
+    << "      \"memory_bytes\": " << camera_bytes(camera) << "\n"
+    << "    }";
+}
+
+} // namespace
+
+size_t resident_bytes() {
+  std::ifstream statm("/proc/self/statm");
+  size_t total_pages;
+  size_t resident_pages;
+  if (!(statm >> total_pages >> resident_pages)) {
+    return 0u;
+  }
+  return resident_pages * size_t(sysconf(_SC_PAGESIZE));
+}
+
+void write_estimate_json(const job_estimate& job, std::ostream& out) {
+  double photon_map_seconds = job.photon_map_seconds / job.photon_fraction;
+  double seconds = photon_map_seconds;
+  size_t camera_peak = 0u;
+  for (const camera_estimate& camera : job.cameras) {
+    seconds += camera_seconds(camera, job.thread_count);
+    camera_peak = std::max(camera_peak, camera_bytes(camera));
+  }
+  size_t replica_bytes = job.node_count > 1u ?
+    (job.node_count - 1u) * job.scene_bytes : 0u;
+  size_t unshot_photon_bytes = size_t(job.photon_map_bytes *
+    (1. / job.photon_fraction - 1.) + 0.5);
+
+  out << "{\n"
+    << "  \"threads\": " << job.thread_count << ",\n"
+    << "  \"seconds\": " << seconds << ",\n"
+    << "  \"peak_memory_bytes\": " << job.prepared_bytes +
+      unshot_photon_bytes + replica_bytes + camera_peak << ",\n"
+    << "  \"photon_map_seconds\": " << photon_map_seconds << ",\n"
+    << "  \"cameras\": [\n";
+  for (size_t i = 0u; i < job.cameras.size(); ++i) {
+    write_camera(job.cameras[i], job.thread_count, out);
+    out << (i + 1u < job.cameras.size() ? ",\n" : "\n");
+  }
+  out << "  ]\n"
+    << "}" << std::endl;
+}
@@ -0,0 +1,70 @@
+#ifndef ESTIMATE_H
+#define ESTIMATE_H
+
+#include <iosfwd>
+#include <string>
+#include <vector>
+#include "render.h"
+
+/* What was measured of rendering one camera, to extrapolate from.
+*/
+struct camera_estimate {
+  camera_estimate()
+    : pixel_count(0u)
+    , gather_point_count(0u)
+    , irradiance_seconds(0.)
+    , photon_pass_seconds(0.)
+    , photon_passes(0u)
+    , buffer_bytes(0u)
+    , gather_scale(1.)
+  {
+  }
+
+  std::string name;
+  size_t pixel_count; // in the crop, all of which the render takes
+  render_sample sample;
+  size_t gather_point_count; // recorded by the sample's pixels
+  double irradiance_seconds; // filling the irradiance cache
+  double photon_pass_seconds; // one pass of progressive photon mapping
+  unsigned photon_passes;
+  size_t buffer_bytes; // as render_buffer_bytes
+  // how many times longer the sample's photon gathers take from the full map
+  double gather_scale;
+};
+
+/* What was measured of a whole render job, to extrapolate from.
+*/
+struct job_estimate {
+  job_estimate()
+    : thread_count(0u)
+    , node_count(0u)
+    , photon_map_seconds(0.)
+    , photon_fraction(1.f)
+    , photon_map_bytes(0u)
+    , scene_bytes(0u)
+    , prepared_bytes(0u)
+  {
+  }
+
+  unsigned thread_count;
+  unsigned node_count; // each node beyond the first gets a copy of the scene
+  double photon_map_seconds; // creating or loading the photon map
+  float photon_fraction; // of the photons the photon map was made with
+  size_t photon_map_bytes; // the memory the photon map took
+  size_t scene_bytes; // the memory loading the scene took
+  size_t prepared_bytes; // the memory in use once ready to render
+  std::vector<camera_estimate> cameras;
+};
+
+// the memory the process has resident, or zero if that can't be read
+size_t resident_bytes();
+
+/* Writes, as JSON, how long the job should take with its threads and the
+   most memory it should need, along with the rays per pixel and time per
+   ray they were extrapolated from. Each camera's sample is scaled up to
+   its whole crop, a photon map of a fraction of the photons up to all of
+   them, and the threads are assumed to share the work evenly.
+*/
+void write_estimate_json(const job_estimate& job, std::ostream& out);
+
+#endif
@@ -379,6 +379,33 @@ struct geometry_t {
   std::vector<mesh_t> meshes;
 };
 
+enum nearest_t {
+  NOTHING_NEAREST,
+  SPHERE_NEAREST,
+  MESH_NEAREST,
+};
+
+inline nearest_t nearest_intersect(
+  const ray_sphere_intersect& rsi,
+  const std::vector<sphere_t>& spheres,
+  const ray_mesh_intersect& rmi,
+  const std::vector<mesh_t>& meshes)
+{
+  if (rsi.intersect_exists(spheres)) {
+    if (rmi.intersect_exists(meshes)) {
+      return rsi.t < rmi.t ? SPHERE_NEAREST : MESH_NEAREST;
+    } else {
+      return SPHERE_NEAREST;
+    }
+  } else {
+    if (rmi.intersect_exists(meshes)) {
+      return MESH_NEAREST;
+    } else {
+      return NOTHING_NEAREST;
+    }
+  }
+}
+
 inline vec3f reflected(const vec3f& incident, const vec3f& normal) {
   return incident -2.f * dot(incident, normal) * normal;
 }
@@ -6,8 +6,65 @@ const char* const help_text =
   "Draws a scene specified by a YAML scene file and outputs a PNG image.\n"
   "Options:\n"
   "[--scene <file>] the scene input file (default: world.yml)\n"
-  "[--output <file>] the rendered output file (default: output.png)\n"
-  "[--threads <number>] the number of rendering threads (default: 1)\n"
+  "[--output <file>] the rendered output file (default: output.png); each\n"
+  "  of a scene's cameras has its own, with the camera's name added before\n"
+  "  the extension, and likewise for the sample map\n"
+  "[--camera <name>] renders only the scene's camera with this name\n"
+  "[--threads <number>|auto] the number of rendering and photon threads,\n"
+  "  or auto for one per hardware thread (default: 1)\n"
+  "[--pin] ties each thread to a CPU, spreading them across NUMA nodes, and\n"
+  "  gives each node its own copy of the scene\n"
+  "[--photon-cache <file>] reuses the photon map saved in the file if it was\n"
+  "  made for the same geometry, materials and lights, or saves it there\n"
+  "[--tile-size <pixels>] the width and height of the tiles the image is\n"
+  "  rendered in, handed to threads in Hilbert curve order (default: 32)\n"
+  "[--sample-map <file>] also outputs an image of the samples each pixel\n"
+  "  took, from black for none to white for the scene's samples\n"
+  "[--sampler <name>] overrides the scene's sampler\n"
+  "[--progressive] saves a snapshot over the output file between passes\n"
+  "  every snapshot interval, or when sent SIGUSR1\n"
+  "[--snapshot-interval <seconds>] the time between snapshots (default: 60)\n"
+  "[--checkpoint <file>] saves the render so far to the file between\n"
+  "  passes every checkpoint interval\n"
+  "[--checkpoint-interval <seconds>] the time between checkpoints\n"
+  "  (default: 300)\n"
+  "[--resume <file>] continues the render saved in the checkpoint file,\n"
+  "  finishing exactly as it would have uninterrupted, and keeps\n"
+  "  checkpointing to it unless --checkpoint is given\n"
+  "[--crop <x0,y0,x1,y1>] overrides the scene's crop\n"
+  "[--composite <file>] pastes the crop into a copy of the image in the\n"
+  "  file, which must be the scene's resolution, rather than outputting\n"
+  "  the crop alone\n"
+  "[--time-limit <seconds>] stops rendering once this long has passed\n"
+  "  since starting, keeping the samples taken so far and checkpointing\n"
+  "  the passes finished; the scene's samples are the most taken\n"
+  "[--target-noise <noise>] stops rendering after the pass that brings the\n"
+  "  root mean square of the pixels' noise, as in noise_threshold, down to\n"
+  "  this\n"
+  "  Every render goes in passes of a growing number of samples, so the\n"
+  "  image is refined evenly whenever it stops. SIGINT or SIGTERM stop\n"
+  "  rendering the same way, and a second one quits\n"
+  "[--workers <number>] renders the crop as jobs on this many worker\n"
+  "  processes, sharing --threads threads between them unpinned, and merges\n"
+  "  their results into the same image one process would render\n"
+  "[--queue <directory>] shares the jobs through the directory instead,\n"
+  "  with the --workers local ones and any others serving it\n"
+  "[--job-size <pixels>] the width and height of each job (default: 128)\n"
+  "[--serve-queue <directory>] renders jobs from the directory until its\n"
+  "  render finishes; the scene, tile size and sampler must match the\n"
+  "  render's, for example from another machine sharing the directory,\n"
+  "  as must the camera, the first of several unless --camera is given\n"
+  "[--preview] first shows a rough render of the scene on the terminal,\n"
+  "  in 24-bit color: as wide as the terminal, one sample per pixel, with\n"
+  "  direct light and shallow reflections and refractions only\n"
+  "[--preview-file <file>] also saves the preview, 80 pixels wide if not\n"
+  "  shown, named for each camera like the output\n"
+  "[--estimate] rather than rendering, prints JSON estimating the time the\n"
+  "  render will take with --threads threads and the most memory it will\n"
+  "  need, from rendering an even spread of about 1024 of each camera's\n"
+  "  pixels, with their rays per pixel and time per ray by kind, and from\n"
+  "  shooting a sixteenth of the photons; a saved photon map is used, but\n"
+  "  none is saved\n"
   "[--progress] displayed a progress indicator as the scene is rendered\n"
   "[--help <topic>] displays this help, or help for a specific topic\n"
   "  topics include: scene";
@@ -16,6 +73,57 @@ const char* const scene_file_help_text =
   "Scene file specification:\n"
   "resolution: [x, y] - required\n  "
   "The dimensions of the output image\n"
+  "crop: [x0, y0, x1, y1] - optional - default the whole image\n  "
+  "Only renders the pixels from (x0, y0) up to but not including (x1, y1),\n  "
+  "and outputs just those. They match the same pixels of a full render\n"
+  "samples: x - optional - default 1\n  "
+  "The number of rays traced through each pixel, or with adaptive\n  "
+  "sampling, the most that may be\n"
+  "noise_threshold: x - optional - default none\n  "
+  "If set, pixels stop taking samples once the standard error of their\n  "
+  "brightness, from 0 to 1, falls below this. 0.01 is typical\n"
+  "min_samples: x - optional - default 16, or samples if fewer\n  "
+  "With noise_threshold, the samples every pixel takes before its noise\n  "
+  "is estimated\n"
+  "integrator: whitted|photon|ppm|path - optional - default whitted\n  "
+  "How light is simulated. whitted traces direct light, reflections and\n  "
+  "refractions; photon adds a photon map for caustics (photon_mapping:\n  "
+  "true is a synonym); ppm refines caustics with progressive photon\n  "
+  "mapping, keeping only one pass of photons in memory at a time; path\n  "
+  "adds diffuse interreflection by path tracing with next-event\n  "
+  "estimation, converging as samples increase\n"
+  "sampler: random|stratified|halton|sobol - optional - default random\n  "
+  "How the random numbers for pixel positions, light choices and photon\n  "
+  "directions are picked. stratified spreads each pixel's samples evenly\n  "
+  "over each number; halton and sobol spread them over several at once,\n  "
+  "sobol with Owen scrambling, and both converge faster than random\n"
+  "photon_radius: x - optional - default 0.25\n  "
+  "The distance from a shaded point that photons are gathered from\n"
+  "photon_neighbors: x - optional - default all\n  "
+  "The number of nearest photons gathered. Where photons are dense, the\n  "
+  "gather radius shrinks to fit them, sharpening caustics\n"
+  "photon_passes: x - optional - default 16\n  "
+  "With the ppm integrator, the number of passes of photons shot. Each\n  "
+  "pass shoots each light's photon_samples photons and shrinks the gather\n  "
+  "radius where photons were found, starting from photon_radius\n"
+  "photon_density: x - optional - default none\n  "
+  "Photons are only emitted towards translucent objects. If set, each\n  "
+  "light emits this many photons per unit of their silhouette area,\n  "
+  "instead of its photon_samples\n"
+  "irradiance_error: x - optional - default none\n  "
+  "With the photon integrator, gather photons only at a sparse grid of\n  "
+  "points first, and interpolate between them where they're close enough\n  "
+  "to a shaded point, allowing about this much error. 0.3 is typical\n"
+  "roulette_depth: x - optional - default none\n  "
+  "The depth from which reflected and refracted rays are randomly\n  "
+  "terminated, with a probability that grows as their contribution shrinks\n"
+  "min_ray_weight: x - optional - default 0\n  "
+  "Reflected and refracted rays contributing less than this fraction\n  "
+  "of a pixel's color are not traced\n"
+  "stochastic_branching: x - optional - default false\n  "
+  "When a surface both reflects and refracts, trace only one of the two\n  "
+  "rays, chosen randomly by their contribution. Noisier per sample, but\n  "
+  "much cheaper for glass near mirrors; raise samples to compensate\n"
   "observer: [x, y, z] - required\n  "
   "The eye position of the viewer\n"
   "screen: - required\n  "
@@ -27,6 +135,13 @@ const char* const scene_file_help_text =
   "The top-right corner of the screen\n"
   "screen_bottom_right: [x, y, z] - required\n  "
   "The bottom-right corner of the screen\n"
+  "cameras: - optional - instead of observer and screen\n  "
+  "A list of viewpoints of the scene, each rendered to its own output,\n  "
+  "sharing the photon map, each composed of:\n"
+  "name: x - required\n  "
+  "The name distinguishing the camera and its output file\n"
+  "observer: and screen: - required\n  "
+  "As above\n"
   "\n"
   "geometry: - required\n  "
   "The physical objects to be rendered, specified by:\n"
@@ -58,6 +173,10 @@ const char* const scene_file_help_text =
   "The fraction of light reflected off the material, between 0 and 1\n"
   "mirrored: - optional - default false\n  "
   "A synonym for reflectivity: 1\n"
+  "lights: [name, ...] - optional - default all lights\n  "
+  "The names of the only lights that illuminate the object\n"
+  "exclude_lights: [name, ...] - optional - default none\n  "
+  "The names of lights that do not illuminate the object\n"
   "\n"
   "lights: - required\n  "
   "The illumination that makes geometry visible, specified by:\n"
@@ -69,6 +188,11 @@ const char* const scene_file_help_text =
   "position: [x, y, z] - required\n  "
   "The position of the light in space\n"
   "color: [r, g, b] - required\n  "
-  "The color of the light, as values from 0 to 1";
+  "The color of the light, as values from 0 to 1\n"
+  "name: x - optional\n  "
+  "The name objects use to link to or exclude the light\n"
+  "influence_radius: x - optional - default unbounded\n  "
+  "The distance at which the light smoothly fades to nothing.\n  "
+  "Objects beyond it are not tested for shadows from this light";
 
 #endif
@@ -1,5 +1,7 @@
 #include <algorithm>
+#include <cstring>
 #include <limits>
+#include <ostream>
 #include <memory>
 #include <stdexcept>
 #include <sstream>
@@ -162,6 +164,86 @@ bool image::save_as_png(const char* path) const {
   return save_png_to_file(output_image, path);
 }
 
+void image::print_as_ansi(std::ostream& out) const {
+  for (unsigned y = 0u; y < height(); y += 2u) {
+    for (unsigned x = 0u; x < width(); ++x) {
+      color_24bit upper = vec3f_to_24bit_color(px(x, y));
+      out << "\x1b[38;2;" << unsigned(upper.red) << ";"
+        << unsigned(upper.green) << ";" << unsigned(upper.blue) << "m";
+      if (y + 1u < height()) {
+        color_24bit lower = vec3f_to_24bit_color(px(x, y + 1u));
+        out << "\x1b[48;2;" << unsigned(lower.red) << ";"
+          << unsigned(lower.green) << ";" << unsigned(lower.blue) << "m";
+      } else {
+        out << "\x1b[49m";
+      }
+      out << "\xe2\x96\x80"; // an upper half block, in UTF-8
+    }
+    out << "\x1b[0m\n";
+  }
+  out.flush();
+}
+
+bool image::load_from_png(const char* path) {
+  png_image png;
+  std::memset(&png, 0, sizeof(png));
+  png.version = PNG_IMAGE_VERSION;
+  if (!png_image_begin_read_from_file(&png, path)) {
+    return false;
+  }
+  png.format = PNG_FORMAT_RGB;
+  std::vector<png_byte> bytes(PNG_IMAGE_SIZE(png));
+  if (!png_image_finish_read(&png, NULL, bytes.data(), 0, NULL)) {
+    png_image_free(&png);
+    return false;
+  }
+
+  image loaded(png.width, png.height);
+  for (size_t i = 0u; i < loaded.pixels.size(); ++i) {
+    // the middle of each step, so converting back truncates to the same byte
+    loaded.pixels[i] = vec3f(bytes[3u * i] + 0.5f,
+      bytes[3u * i + 1u] + 0.5f, bytes[3u * i + 2u] + 0.5f) / 255.f;
+  }
+  *this = loaded;
+  return true;
+}
+
+image image::region(unsigned x0, unsigned y0, unsigned x1, unsigned y1) const {
+  image part(x1 - x0, y1 - y0);
+  for (unsigned y = y0; y < y1; ++y) {
+    std::copy(pixels.begin() + y * width_ + x0,
+      pixels.begin() + y * width_ + x1,
+      part.pixels.begin() + (y - y0) * part.width_);
+  }
+  return part;
+}
+
+void image::paste(const image& other, unsigned x, unsigned y) {
+  for (unsigned row = 0u; row < other.height(); ++row) {
+    std::copy(other.pixels.begin() + row * other.width_,
+      other.pixels.begin() + (row + 1u) * other.width_,
+      pixels.begin() + (y + row) * width_ + x);
+  }
+}
+
+accumulation_buffer::accumulation_buffer(unsigned width, unsigned height)
+  : light(size_t(width) * height, vec3f(0,0,0))
+  , sample_counts(size_t(width) * height, 0u)
+  , brightness_sums(size_t(width) * height, 0.f)
+  , brightness_sums_sq(size_t(width) * height, 0.f)
+  , width_(width)
+{
+}
+
+image accumulation_buffer::average() const {
+  image img(width(), height());
+  for (size_t i = 0u; i < light.size(); ++i) {
+    img.pixels[i] = sample_counts[i] ? light[i] / float(sample_counts[i]) :
+      vec3f(0,0,0);
+  }
+  return img;
+}
+
 void image::clamp_colors() {
   std::transform(pixels.begin(), pixels.end(),
     pixels.begin(), clamp_color);
@@ -1,6 +1,7 @@
 #ifndef IMAGE_H
 #define IMAGE_H
 
+#include <iosfwd>
 #include <vector>
 #include "vec3f.h"
 
@@ -13,9 +14,26 @@ struct image {
   const vec3f& px(unsigned x, unsigned y) const;
 
   bool save_as_png(const char* path) const;
+
+  /* Draws the image on a terminal with 24-bit color, two pixels to a
+     character, as upper half blocks over their lower pixel's color.
+  */
+  void print_as_ansi(std::ostream& out) const;
+
+  /* Replaces the image with the one in the file, returning false, leaving
+     it untouched, if it can't be read. Pixels are read so that saving them
+     again gives back the same values.
+  */
+  bool load_from_png(const char* path);
+
   void clamp_colors();
 
-private:
+  // the pixels from (x0, y0) up to but not including (x1, y1)
+  image region(unsigned x0, unsigned y0, unsigned x1, unsigned y1) const;
+
+  // copies another image's pixels over this one's, from (x, y)
+  void paste(const image& other, unsigned x, unsigned y);
+
   unsigned height() const;
   unsigned width() const;
 
@@ -23,6 +41,33 @@ private:
   unsigned width_;
 };
 
+/* The running totals of a render in progress. For each pixel, the sum of
+   the samples taken and how many, and the sum and sum of squares of their
+   brightness, from which their noise is estimated.
+*/
+struct accumulation_buffer {
+  accumulation_buffer(unsigned width, unsigned height);
+
+  std::vector<vec3f> light;
+  std::vector<unsigned> sample_counts;
+  std::vector<float> brightness_sums;
+  std::vector<float> brightness_sums_sq;
+
+  // the average of each pixel's samples, black if it has none
+  image average() const;
+
+  unsigned width() const {
+    return width_;
+  }
+
+  unsigned height() const {
+    return unsigned(light.size() / width_);
+  }
+
+private:
+  unsigned width_;
+};
+
 inline vec3f& image::px(unsigned x, unsigned y) {
   return pixels[y * width_ + x];
 }
@@ -0,0 +1,146 @@
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include "irradiance_cache.h"
+
+irradiance_cache g_irradiance_cache;
+
+namespace {
+
+// records with points this far in front of them, as a fraction of their
+// radius, are not reused, since the point may see light they can't
+const float IN_FRONT_TOLERANCE = 0.05f;
+
+// the deepest a record is placed, in case its reach is tiny
+const unsigned MAX_DEPTH = 24u;
+
+size_t octant_of(const vec3f& position, const vec3f& center) {
+  return (position[0] > center[0] ? 1u : 0u) |
+    (position[1] > center[1] ? 2u : 0u) |
+    (position[2] > center[2] ? 4u : 0u);
+}
+
+} // namespace
+
+irradiance_cache::irradiance_cache()
+  : max_error_(0.f)
+{
+}
+
+irradiance_cache::irradiance_cache(float max_error)
+  : max_error_(max_error)
+{
+}
+
+void irradiance_cache::build(std::vector<irradiance_record> records) {
+  records_ = std::move(records);
+  nodes_.clear();
+  if (records_.empty()) {
+    return;
+  }
+
+  vec3f lower(FLT_MAX, FLT_MAX, FLT_MAX);
+  vec3f upper(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+  float largest_reach = 0.f;
+  for (const irradiance_record& record : records_) {
+    for (size_t axis = 0u; axis < 3u; ++axis) {
+      lower[axis] = std::min(lower[axis], record.position[axis]);
+      upper[axis] = std::max(upper[axis], record.position[axis]);
+    }
+    largest_reach = std::max(largest_reach, max_error_ * record.radius);
+  }
+  vec3f extent = upper - lower;
+  node root;
+  root.center = lower / 2.f + upper / 2.f;
+  // the root's loose bounds must hold every point a record reaches, even
+  // when the records are all close together
+  root.half_size = std::max({extent[0] / 2.f, extent[1] / 2.f,
+    extent[2] / 2.f, largest_reach, FLT_MIN});
+  std::fill(root.children, root.children + 8, -1);
+  nodes_.push_back(root);
+
+  for (size_t i = 0u; i < records_.size(); ++i) {
+    insert(uint32_t(i));
+  }
+}
+
+void irradiance_cache::insert(uint32_t record_idx) {
+  const irradiance_record& record = records_[record_idx];
+  float reach = max_error_ * record.radius;
+  size_t current = 0u;
+  // a child's loose bounds hold the record's reach if it's half as big
+  for (unsigned depth = 0u;
+    depth < MAX_DEPTH && nodes_[current].half_size / 2.f >= reach; ++depth)
+  {
+    size_t octant = octant_of(record.position, nodes_[current].center);
+    if (nodes_[current].children[octant] < 0) {
+      node child;
+      float quarter = nodes_[current].half_size / 2.f;
+      child.center = nodes_[current].center + vec3f(
+        octant & 1u ? quarter : -quarter,
+        octant & 2u ? quarter : -quarter,
+        octant & 4u ? quarter : -quarter);
+      child.half_size = quarter;
+      std::fill(child.children, child.children + 8, -1);
+      nodes_[current].children[octant] = int32_t(nodes_.size());
+      nodes_.push_back(child);
+    }
+    current = nodes_[current].children[octant];
+  }
+  nodes_[current].records.push_back(record_idx);
+}
+
+bool irradiance_cache::interpolate(const vec3f& position, const vec3f& normal,
+  uint32_t object, vec3f& light) const
+{
+  if (records_.empty()) {
+    return false;
+  }
+  vec3f weighted(0,0,0);
+  float total_weight = 0.f;
+  gather(0u, position, normal, object, weighted, total_weight);
+  if (total_weight <= 0.f) {
+    return false;
+  }
+  light = weighted / total_weight;
+  return true;
+}
+
+void irradiance_cache::gather(size_t node_idx, const vec3f& position,
+  const vec3f& normal, uint32_t object, vec3f& weighted,
+  float& total_weight) const
+{
+  const node& n = nodes_[node_idx];
+  // the loose bounds extend half a node beyond the node on every side
+  float loose = 2.f * n.half_size;
+  if (std::abs(position[0] - n.center[0]) > loose ||
+      std::abs(position[1] - n.center[1]) > loose ||
+      std::abs(position[2] - n.center[2]) > loose) {
+    return;
+  }
+
+  for (uint32_t record_idx : n.records) {
+    const irradiance_record& record = records_[record_idx];
+    if (record.object != object || record.radius <= 0.f) {
+      continue;
+    }
+    vec3f offset = position - record.position;
+    float in_front = dot(offset, (normal + record.normal) / 2.f);
+    if (in_front < -IN_FRONT_TOLERANCE * record.radius) {
+      continue;
+    }
+    float error = magnitude(offset) / record.radius +
+      std::sqrt(std::max(1.f - dot(normal, record.normal), 0.f));
+    if (error < max_error_) {
+      float weight = 1.f / std::max(error, 1e-6f);
+      weighted += weight * record.light;
+      total_weight += weight;
+    }
+  }
+
+  for (int32_t child : n.children) {
+    if (child >= 0) {
+      gather(size_t(child), position, normal, object, weighted, total_weight);
+    }
+  }
+}
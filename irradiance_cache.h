@@ -0,0 +1,69 @@
+#ifndef IRRADIANCE_CACHE_H
+#define IRRADIANCE_CACHE_H
+
+#include <cstdint>
+#include <vector>
+#include "vec3f.h"
+
+/* Indirect light computed at one surface point, and the distance over
+   which it varies slowly enough to be reused.
+*/
+struct irradiance_record {
+  vec3f position;
+  vec3f normal;
+  vec3f light;
+  float radius;
+  uint32_t object; // records only apply to the object they were made on
+  unsigned pixel; // the pixel that made it, to keep the records in order
+};
+
+/* irradiance cache - reuses indirect light between nearby surface points
+
+   Records are kept in a loose octree, each in the smallest node at least
+   as large as the region it can be reused in, so only the nodes whose
+   loose bounds contain a point need searching. The light at a point is
+   interpolated from the records near it with Ward's weights, 1 / (distance
+   / radius + sqrt(1 - cos(normal difference))), using the records whose
+   weight exceeds 1 / max_error.
+*/
+class irradiance_cache {
+public:
+  irradiance_cache();
+  explicit irradiance_cache(float max_error);
+
+  void build(std::vector<irradiance_record> records);
+
+  bool empty() const {
+    return records_.empty();
+  }
+
+  size_t size() const {
+    return records_.size();
+  }
+
+  /* Sets light to the interpolated light at the point, if any records
+     are close enough. Otherwise returns false, leaving light untouched.
+  */
+  bool interpolate(const vec3f& position, const vec3f& normal,
+    uint32_t object, vec3f& light) const;
+
+private:
+  struct node {
+    vec3f center;
+    float half_size;
+    int32_t children[8];
+    std::vector<uint32_t> records;
+  };
+
+  void insert(uint32_t record_idx);
+  void gather(size_t node_idx, const vec3f& position, const vec3f& normal,
+    uint32_t object, vec3f& weighted, float& total_weight) const;
+
+  float max_error_;
+  std::vector<irradiance_record> records_;
+  std::vector<node> nodes_;
+};
+
+extern irradiance_cache g_irradiance_cache;
+
+#endif
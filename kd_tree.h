@@ -0,0 +1,288 @@
+#ifndef KD_TREE_H
+#define KD_TREE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include "vec3f.h"
+
+/* A point found by searching a kd_tree, and its squared distance from the
+   search position.
+*/
+template<class T>
+struct kd_neighbor {
+  float dist_sq;
+  const T* point;
+};
+
+template<class T>
+inline bool operator<(const kd_neighbor<T>& lhs, const kd_neighbor<T>& rhs) {
+  return lhs.dist_sq < rhs.dist_sq;
+}
+
+/* kd-tree - a balanced tree for finding the points near a position
+
+   The points are kept in one array in tree order, with no child pointers.
+   The node for any range of the array is its middle element, and the
+   elements before it are not above it along its split axis, while those
+   after it are not below it. The split axis of each node is the one along
+   which its range is widest, and is kept in a parallel array of bytes.
+
+   A kd_tree_view searches a tree laid out in memory it doesn't own, so
+   many trees can share one array. Position is a function object returning
+   the vec3f position of a T.
+*/
+template<class T, class Position>
+class kd_tree_view {
+public:
+  kd_tree_view()
+    : points_(0)
+    , axes_(0)
+    , size_(0u)
+  {
+  }
+
+  kd_tree_view(const T* points, const uint8_t* axes, size_t size,
+    Position position = Position())
+    : points_(points)
+    , axes_(axes)
+    , size_(size)
+    , position_(position)
+  {
+  }
+
+  /* Reorders the points into tree order, filling in their split axes.
+  */
+  static void build(T* points, uint8_t* axes, size_t size,
+    Position position = Position())
+  {
+    build(points, axes, 0u, size, position);
+  }
+
+  size_t size() const {
+    return size_;
+  }
+
+  bool empty() const {
+    return size_ == 0u;
+  }
+
+  // the points, in tree order
+  const T* points() const {
+    return points_;
+  }
+
+  // the split axis of the node at each position in points()
+  const uint8_t* axes() const {
+    return axes_;
+  }
+
+  const Position& position() const {
+    return position_;
+  }
+
+  /* Calls visit(point, dist_sq) for every point closer than radius.
+  */
+  template<class F>
+  void for_each_within(const vec3f& center, float radius, F visit) const {
+    visit_within(0u, size_, center, radius * radius, visit);
+  }
+
+  /* Finds the k points nearest to center and closer than radius,
+     sorted nearest first.
+  */
+  void nearest(const vec3f& center, size_t k, float radius,
+    std::vector<kd_neighbor<T>>& found) const
+  {
+    found.clear();
+    if (k == 0u) {
+      return;
+    }
+    float radius_sq = radius * radius;
+    visit_nearest(0u, size_, center, k, radius_sq, found);
+    std::sort_heap(found.begin(), found.end());
+  }
+
+private:
+  static void build(T* points, uint8_t* axes, size_t begin, size_t end,
+    const Position& position)
+  {
+    if (end - begin < 2u) {
+      if (end > begin) {
+        axes[begin] = 0u;
+      }
+      return;
+    }
+
+    vec3f lower = position(points[begin]);
+    vec3f upper = lower;
+    for (size_t i = begin + 1u; i < end; ++i) {
+      const vec3f p = position(points[i]);
+      for (size_t axis = 0u; axis < 3u; ++axis) {
+        lower[axis] = std::min(lower[axis], p[axis]);
+        upper[axis] = std::max(upper[axis], p[axis]);
+      }
+    }
+    vec3f extent = upper - lower;
+    uint8_t axis = extent[0] >= extent[1] ?
+      (extent[0] >= extent[2] ? 0u : 2u) : (extent[1] >= extent[2] ? 1u : 2u);
+
+    size_t middle = begin + (end - begin) / 2u;
+    std::nth_element(points + begin, points + middle, points + end,
+      [&position, axis](const T& lhs, const T& rhs) {
+        return position(lhs)[axis] < position(rhs)[axis];
+      });
+    axes[middle] = axis;
+
+    build(points, axes, begin, middle, position);
+    build(points, axes, middle + 1u, end, position);
+  }
+
+  template<class F>
+  void visit_within(size_t begin, size_t end, const vec3f& center,
+    float radius_sq, F& visit) const
+  {
+    while (begin < end) {
+      size_t middle = begin + (end - begin) / 2u;
+      const T& point = points_[middle];
+      const vec3f p = position_(point);
+      const vec3f d = p - center;
+      float dist_sq = dot(d, d);
+      if (dist_sq < radius_sq) {
+        visit(point, dist_sq);
+      }
+
+      float offset = center[axes_[middle]] - p[axes_[middle]];
+      bool below = offset < 0.f;
+      if (offset * offset < radius_sq) {
+        if (below) {
+          visit_within(middle + 1u, end, center, radius_sq, visit);
+        } else {
+          visit_within(begin, middle, center, radius_sq, visit);
+        }
+      }
+      if (below) {
+        end = middle;
+      } else {
+        begin = middle + 1u;
+      }
+    }
+  }
+
+  void visit_nearest(size_t begin, size_t end, const vec3f& center,
+    size_t k, float& radius_sq, std::vector<kd_neighbor<T>>& found) const
+  {
+    if (begin >= end) {
+      return;
+    }
+    size_t middle = begin + (end - begin) / 2u;
+    const T& point = points_[middle];
+    const vec3f p = position_(point);
+    float offset = center[axes_[middle]] - p[axes_[middle]];
+    bool below = offset < 0.f;
+
+    // search the side the center is on first, so the radius shrinks sooner
+    if (below) {
+      visit_nearest(begin, middle, center, k, radius_sq, found);
+    } else {
+      visit_nearest(middle + 1u, end, center, k, radius_sq, found);
+    }
+
+    const vec3f d = p - center;
+    float dist_sq = dot(d, d);
+    if (dist_sq < radius_sq) {
+      if (found.size() == k) {
+        std::pop_heap(found.begin(), found.end());
+        found.pop_back();
+      }
+      found.push_back(kd_neighbor<T>{ dist_sq, &point });
+      std::push_heap(found.begin(), found.end());
+      if (found.size() == k) {
+        radius_sq = found.front().dist_sq;
+      }
+    }
+
+    if (offset * offset < radius_sq) {
+      if (below) {
+        visit_nearest(middle + 1u, end, center, k, radius_sq, found);
+      } else {
+        visit_nearest(begin, middle, center, k, radius_sq, found);
+      }
+    }
+  }
+
+  const T* points_;
+  const uint8_t* axes_;
+  size_t size_;
+  Position position_;
+};
+
+/* A kd-tree that owns its points.
+*/
+template<class T, class Position>
+class kd_tree {
+public:
+  kd_tree() {
+  }
+
+  explicit kd_tree(std::vector<T> points, Position position = Position())
+    : points_(std::move(points))
+    , axes_(points_.size())
+    , position_(position)
+  {
+    kd_tree_view<T, Position>::build(points_.data(), axes_.data(),
+      points_.size(), position_);
+  }
+
+  /* Restores a tree from the points() and axes() of one built earlier.
+  */
+  kd_tree(std::vector<T> points, std::vector<uint8_t> axes,
+    Position position = Position())
+    : points_(std::move(points))
+    , axes_(std::move(axes))
+    , position_(position)
+  {
+  }
+
+  size_t size() const {
+    return points_.size();
+  }
+
+  bool empty() const {
+    return points_.empty();
+  }
+
+  // the points, in tree order
+  const std::vector<T>& points() const {
+    return points_;
+  }
+
+  // the split axis of the node at each position in points()
+  const std::vector<uint8_t>& axes() const {
+    return axes_;
+  }
+
+  kd_tree_view<T, Position> view() const {
+    return kd_tree_view<T, Position>(points_.data(), axes_.data(),
+      points_.size(), position_);
+  }
+
+  template<class F>
+  void for_each_within(const vec3f& center, float radius, F visit) const {
+    view().for_each_within(center, radius, visit);
+  }
+
+  void nearest(const vec3f& center, size_t k, float radius,
+    std::vector<kd_neighbor<T>>& found) const
+  {
+    view().nearest(center, k, radius, found);
+  }
+
+private:
+  std::vector<T> points_;
+  std::vector<uint8_t> axes_;
+  Position position_;
+};
+
+#endif
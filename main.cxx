@@ -1,12 +1,25 @@
+#include <algorithm>
+#include <chrono>
+#include <csignal>
 #include <iostream>
-#include <random>
 #include <sstream>
-#include <thread>
+#include <string>
 #include <vector>
+#include <sys/ioctl.h>
+#include <unistd.h>
 #include "geometry.h"
+#include "checkpoint.h"
+#include "distributed.h"
+#include "estimate.h"
 #include "help_text.h"
 #include "image.h"
+#include "irradiance_cache.h"
+#include "photon_cache.h"
+#include "photon_map.h"
+#include "render.h"
 #include "scene.h"
+#include "thread_pool.h"
+#include "trace.h"
 #include "vec3f.h"
 
 enum {
@@ -16,31 +29,112 @@ enum {
   EXIT_BAD_ARGS,
 };
 
+// the irradiance cache prepass traces one pixel in this many, each way
+const unsigned IRRADIANCE_PREPASS_STRIDE = 4u;
+
+// estimates render about this many of each camera's pixels
+const unsigned ESTIMATE_PIXELS = 1024u;
+
+// estimates shoot this fraction of the photons, and scale up what it took
+const float ESTIMATE_PHOTON_FRACTION = 1.f / 16.f;
+
+// previews not shown on a terminal are this many pixels wide
+const unsigned DEFAULT_PREVIEW_WIDTH = 80u;
+
 enum {
   INVALID_ARG = -1,
   HELP_ARG,
   SCENE_FILE_ARG,
   OUTPUT_FILE_ARG,
   THREAD_COUNT_ARG,
+  PHOTON_CACHE_ARG,
+  TILE_SIZE_ARG,
+  SAMPLE_MAP_ARG,
+  SAMPLER_ARG,
+  SNAPSHOT_INTERVAL_ARG,
+  CHECKPOINT_FILE_ARG,
+  CHECKPOINT_INTERVAL_ARG,
+  RESUME_FILE_ARG,
+  TIME_LIMIT_ARG,
+  TARGET_NOISE_ARG,
+  CROP_ARG,
+  COMPOSITE_FILE_ARG,
+  WORKER_COUNT_ARG,
+  QUEUE_DIR_ARG,
+  JOB_SIZE_ARG,
+  SERVE_QUEUE_ARG,
+  CAMERA_ARG,
+  PREVIEW_FILE_ARG,
 };
 
 struct user_inputs {
   user_inputs()
     : scene_file(0)
     , output_file(0)
+    , photon_cache_file(0)
+    , sample_map_file(0)
+    , checkpoint_file(0)
+    , resume_file(0)
+    , composite_file(0)
+    , queue_dir(0)
+    , serve_queue_dir(0)
+    , camera_name(0)
+    , preview_file(0)
+    , sampler_name(0)
     , thread_count(1)
+    , tile_size(32)
+    , worker_count(0)
+    , job_size(128)
+    , sampler(RANDOM_SAMPLER)
+    , overrides_sampler(false)
+    , overrides_crop(false)
+    , snapshot_interval(60.f)
+    , checkpoint_interval(300.f)
+    , time_limit(0.f)
+    , target_noise(0.f)
     , requests_help(false)
     , requests_help_scene(false)
     , display_progress(false)
+    , progressive(false)
+    , pins_threads(false)
+    , serves_pipe(false)
+    , previews(false)
+    , estimates(false)
   {
   }
 
   const char* scene_file;
   const char* output_file;
-  unsigned thread_count;
+  const char* photon_cache_file;
+  const char* sample_map_file;
+  const char* checkpoint_file;
+  const char* resume_file;
+  const char* composite_file;
+  const char* queue_dir;
+  const char* serve_queue_dir;
+  const char* camera_name;
+  const char* preview_file;
+  const char* sampler_name;
+  unsigned thread_count; // 0 for one per hardware thread
+  unsigned tile_size;
+  unsigned worker_count;
+  unsigned job_size;
+  sampler_t sampler;
+  bool overrides_sampler;
+  crop_t crop;
+  bool overrides_crop;
+  float snapshot_interval;
+  float checkpoint_interval;
+  float time_limit;
+  float target_noise;
   bool requests_help;
   bool requests_help_scene;
   bool display_progress;
+  bool progressive;
+  bool pins_threads;
+  bool serves_pipe;
+  bool previews;
+  bool estimates;
 };
 
 user_inputs parse_inputs(int argc, char** argv) {
@@ -53,20 +147,171 @@ user_inputs parse_inputs(int argc, char** argv) {
     } else if (next_expected_arg == OUTPUT_FILE_ARG) {
       in.output_file = argv[i];
       next_expected_arg = INVALID_ARG;
+    } else if (next_expected_arg == PHOTON_CACHE_ARG) {
+      in.photon_cache_file = argv[i];
+      next_expected_arg = INVALID_ARG;
+    } else if (next_expected_arg == SAMPLE_MAP_ARG) {
+      in.sample_map_file = argv[i];
+      next_expected_arg = INVALID_ARG;
+    } else if (next_expected_arg == SAMPLER_ARG) {
+      if (!sampler_from_name(argv[i], in.sampler)) {
+        std::cerr << "Unknown sampler: " << argv[i] << std::endl;
+        std::exit(EXIT_BAD_ARGS);
+      }
+      in.overrides_sampler = true;
+      in.sampler_name = argv[i];
+      next_expected_arg = INVALID_ARG;
+    } else if (next_expected_arg == CROP_ARG) {
+      std::istringstream input(argv[i]);
+      char comma[3];
+      input >> in.crop.x0 >> comma[0] >> in.crop.y0 >> comma[1] >>
+        in.crop.x1 >> comma[2] >> in.crop.y1;
+      if (!input || comma[0] != ',' || comma[1] != ',' || comma[2] != ',' ||
+        input.get() != EOF)
+      {
+        std::cerr << "Invalid crop: " << argv[i] << std::endl;
+        std::exit(EXIT_BAD_ARGS);
+      }
+      in.overrides_crop = true;
+      next_expected_arg = INVALID_ARG;
+    } else if (next_expected_arg == WORKER_COUNT_ARG) {
+      std::istringstream input(argv[i]);
+      input >> in.worker_count;
+      if (!input || in.worker_count == 0u) {
+        std::cerr << "Invalid worker count: " << argv[i] << std::endl;
+        std::exit(EXIT_BAD_ARGS);
+      }
+      next_expected_arg = INVALID_ARG;
+    } else if (next_expected_arg == JOB_SIZE_ARG) {
+      std::istringstream input(argv[i]);
+      input >> in.job_size;
+      if (!input || in.job_size == 0u) {
+        std::cerr << "Invalid job size: " << argv[i] << std::endl;
+        std::exit(EXIT_BAD_ARGS);
+      }
+      next_expected_arg = INVALID_ARG;
+    } else if (next_expected_arg == QUEUE_DIR_ARG) {
+      in.queue_dir = argv[i];
+      next_expected_arg = INVALID_ARG;
+    } else if (next_expected_arg == SERVE_QUEUE_ARG) {
+      in.serve_queue_dir = argv[i];
+      next_expected_arg = INVALID_ARG;
+    } else if (next_expected_arg == CAMERA_ARG) {
+      in.camera_name = argv[i];
+      next_expected_arg = INVALID_ARG;
+    } else if (next_expected_arg == PREVIEW_FILE_ARG) {
+      in.preview_file = argv[i];
+      next_expected_arg = INVALID_ARG;
+    } else if (next_expected_arg == COMPOSITE_FILE_ARG) {
+      in.composite_file = argv[i];
+      next_expected_arg = INVALID_ARG;
+    } else if (next_expected_arg == CHECKPOINT_FILE_ARG) {
+      in.checkpoint_file = argv[i];
+      next_expected_arg = INVALID_ARG;
+    } else if (next_expected_arg == RESUME_FILE_ARG) {
+      in.resume_file = argv[i];
+      next_expected_arg = INVALID_ARG;
+    } else if (next_expected_arg == CHECKPOINT_INTERVAL_ARG) {
+      std::istringstream input(argv[i]);
+      input >> in.checkpoint_interval;
+      if (!input || in.checkpoint_interval < 0.f) {
+        std::cerr << "Invalid checkpoint interval: " << argv[i] << std::endl;
+        std::exit(EXIT_BAD_ARGS);
+      }
+      next_expected_arg = INVALID_ARG;
+    } else if (next_expected_arg == TIME_LIMIT_ARG) {
+      std::istringstream input(argv[i]);
+      input >> in.time_limit;
+      if (!input || in.time_limit <= 0.f) {
+        std::cerr << "Invalid time limit: " << argv[i] << std::endl;
+        std::exit(EXIT_BAD_ARGS);
+      }
+      next_expected_arg = INVALID_ARG;
+    } else if (next_expected_arg == TARGET_NOISE_ARG) {
+      std::istringstream input(argv[i]);
+      input >> in.target_noise;
+      if (!input || in.target_noise <= 0.f) {
+        std::cerr << "Invalid target noise: " << argv[i] << std::endl;
+        std::exit(EXIT_BAD_ARGS);
+      }
+      next_expected_arg = INVALID_ARG;
+    } else if (next_expected_arg == SNAPSHOT_INTERVAL_ARG) {
+      std::istringstream input(argv[i]);
+      input >> in.snapshot_interval;
+      if (!input || in.snapshot_interval < 0.f) {
+        std::cerr << "Invalid snapshot interval: " << argv[i] << std::endl;
+        std::exit(EXIT_BAD_ARGS);
+      }
+      next_expected_arg = INVALID_ARG;
     } else if (next_expected_arg == THREAD_COUNT_ARG) {
       std::istringstream input(argv[i]);
-      input >> in.thread_count;
-      if (!input) {
+      if (!strcmp(argv[i], "auto")) {
+        in.thread_count = 0u;
+      } else if (!(input >> in.thread_count) || in.thread_count == 0u) {
         std::cerr << "Invalid thread count: " << argv[i] << std::endl;
         std::exit(EXIT_BAD_ARGS);
       }
       next_expected_arg = INVALID_ARG;
+    } else if (next_expected_arg == TILE_SIZE_ARG) {
+      std::istringstream input(argv[i]);
+      input >> in.tile_size;
+      if (!input || in.tile_size == 0u) {
+        std::cerr << "Invalid tile size: " << argv[i] << std::endl;
+        std::exit(EXIT_BAD_ARGS);
+      }
+      next_expected_arg = INVALID_ARG;
     } else if (!strcmp(argv[i], "--scene")) {
       next_expected_arg = SCENE_FILE_ARG;
     } else if (!strcmp(argv[i], "--output")) {
       next_expected_arg = OUTPUT_FILE_ARG;
     } else if (!strcmp(argv[i], "--threads") || !strcmp(argv[i], "-j")) {
       next_expected_arg = THREAD_COUNT_ARG;
+    } else if (!strcmp(argv[i], "--photon-cache")) {
+      next_expected_arg = PHOTON_CACHE_ARG;
+    } else if (!strcmp(argv[i], "--tile-size")) {
+      next_expected_arg = TILE_SIZE_ARG;
+    } else if (!strcmp(argv[i], "--sample-map")) {
+      next_expected_arg = SAMPLE_MAP_ARG;
+    } else if (!strcmp(argv[i], "--sampler")) {
+      next_expected_arg = SAMPLER_ARG;
+    } else if (!strcmp(argv[i], "--snapshot-interval")) {
+      next_expected_arg = SNAPSHOT_INTERVAL_ARG;
+    } else if (!strcmp(argv[i], "--crop")) {
+      next_expected_arg = CROP_ARG;
+    } else if (!strcmp(argv[i], "--workers")) {
+      next_expected_arg = WORKER_COUNT_ARG;
+    } else if (!strcmp(argv[i], "--queue")) {
+      next_expected_arg = QUEUE_DIR_ARG;
+    } else if (!strcmp(argv[i], "--job-size")) {
+      next_expected_arg = JOB_SIZE_ARG;
+    } else if (!strcmp(argv[i], "--serve-queue")) {
+      next_expected_arg = SERVE_QUEUE_ARG;
+    } else if (!strcmp(argv[i], "--camera")) {
+      next_expected_arg = CAMERA_ARG;
+    } else if (!strcmp(argv[i], "--preview")) {
+      in.previews = true;
+    } else if (!strcmp(argv[i], "--estimate")) {
+      in.estimates = true;
+    } else if (!strcmp(argv[i], "--preview-file")) {
+      next_expected_arg = PREVIEW_FILE_ARG;
+    } else if (!strcmp(argv[i], "--worker")) {
+      in.serves_pipe = true;
+    } else if (!strcmp(argv[i], "--composite")) {
+      next_expected_arg = COMPOSITE_FILE_ARG;
+    } else if (!strcmp(argv[i], "--checkpoint")) {
+      next_expected_arg = CHECKPOINT_FILE_ARG;
+    } else if (!strcmp(argv[i], "--checkpoint-interval")) {
+      next_expected_arg = CHECKPOINT_INTERVAL_ARG;
+    } else if (!strcmp(argv[i], "--resume")) {
+      next_expected_arg = RESUME_FILE_ARG;
+    } else if (!strcmp(argv[i], "--time-limit")) {
+      next_expected_arg = TIME_LIMIT_ARG;
+    } else if (!strcmp(argv[i], "--target-noise")) {
+      next_expected_arg = TARGET_NOISE_ARG;
+    } else if (!strcmp(argv[i], "--pin")) {
+      in.pins_threads = true;
+    } else if (!strcmp(argv[i], "--progressive")) {
+      in.progressive = true;
     } else if (!strcmp(argv[i], "--progress")) {
       in.display_progress = true;;
     } else if (!strcmp(argv[i], "--help")) {
@@ -90,482 +335,405 @@ const char* get_with_default(const char* primary, const char* fallback) {
   return primary ? primary : fallback;
 }
 
-enum nearest_t {
-  NOTHING_NEAREST,
-  SPHERE_NEAREST,
-  MESH_NEAREST,
-};
-
-nearest_t nearest_intersect(
-  const ray_sphere_intersect& rsi,
-  const std::vector<sphere_t>& spheres,
-  const ray_mesh_intersect& rmi,
-  const std::vector<mesh_t>& meshes)
+/* The command that starts a worker on the same render as this process,
+   with the options that change what it renders. The workers all run on
+   this machine, so they share its threads between them rather than each
+   taking as many, and leave them unpinned so they don't pin to the same
+   CPUs.
+*/
+std::vector<std::string> worker_command(const user_inputs& user,
+  const camera_t& camera, unsigned thread_count, const char* program)
 {
-  if (rsi.intersect_exists(spheres)) {
-    if (rmi.intersect_exists(meshes)) {
-      return rsi.t < rmi.t ? SPHERE_NEAREST : MESH_NEAREST;
-    } else {
-      return SPHERE_NEAREST;
-    }
-  } else {
-    if (rmi.intersect_exists(meshes)) {
-      return MESH_NEAREST;
-    } else {
-      return NOTHING_NEAREST;
-    }
+  std::vector<std::string> command;
+  // the running executable, even if it was found through the PATH
+  command.push_back(access("/proc/self/exe", X_OK) == 0 ? "/proc/self/exe" :
+    program);
+  command.push_back("--scene");
+  command.push_back(get_with_default(user.scene_file, "world.yml"));
+  std::ostringstream tile_size;
+  tile_size << user.tile_size;
+  command.push_back("--tile-size");
+  command.push_back(tile_size.str());
+  std::ostringstream worker_threads;
+  worker_threads << std::max(thread_count / std::max(user.worker_count, 1u),
+    1u);
+  command.push_back("--threads");
+  command.push_back(worker_threads.str());
+  if (user.sampler_name) {
+    command.push_back("--sampler");
+    command.push_back(user.sampler_name);
   }
+  if (user.photon_cache_file) {
+    command.push_back("--photon-cache");
+    command.push_back(user.photon_cache_file);
+  }
+  if (!camera.name.empty()) {
+    command.push_back("--camera");
+    command.push_back(camera.name);
+  }
+  return command;
 }
 
-enum cast_policy_t {
-  CAST_TO_OBJECT,
-  CAST_TO_LIGHT,
-};
+/* Reuses the photon map saved for this scene, if there is one, or creates
+   it and saves it for next time.
+*/
+void prepare_photon_map(const scene_t& s, const user_inputs& user,
+  thread_pool& pool)
+{
+  const char* cache_file = user.photon_cache_file;
+  if (!cache_file || s.integrator != PHOTON_INTEGRATOR) {
+    create_photon_map(s, pool);
+    return;
+  }
 
-// The maximum recursive depth
-const unsigned MAX_RECURSE = 10u;
-
-// The distance along the ray that the collision is offset by,
-// to ensure floating point inaccuracy doesn't result in recollision
-// with the same surface upon recasting from the collision point.
-// Overall, it's a bit of a hack. A backoff algorithm would be more
-// appropriate.
-const float BACKOFF = 1e-3f;
-
-// takes two random numbers [0..1] and returns a random direction
-//vec3f random_direction(float x1, float x2) {
-//  const float TWO_PI = 2 * M_PI;
-//  x2 = 2 * x2 - 1; // [-1..1]
-//  return vec3f(sin(TWO_PI * x1), cos(TWO_PI * x1), 2*asin(x2)/M_PI);
-//}
-
-template<class T>
-vec3f random_direction(T& rng) {
-  vec3f v;
-  float m2;
-  do {
-    v = vec3f(rng(), rng(), rng());
-    m2 = v.x()*v.x() + v.y()*v.y() + v.z()*v.z();
-  } while(m2 > 1);
-  return v / sqrt(m2);
+  if (load_photon_cache(cache_file, s, g_photon_map)) {
+    std::cout << "Loaded photon map from " << cache_file << std::endl;
+    return;
+  }
+  create_photon_map(s, pool);
+  if (!save_photon_cache(cache_file, s, g_photon_map)) {
+    std::cerr << "Failed to save photon map to " << cache_file << std::endl;
+  }
 }
 
-template<class T>
-vec3f random_downward_direction(T& rng) {
-  vec3f v = random_direction(rng);
-  if (v.y() > 0) {
-    v[1] = -v[1];
+/* The scene with each light shooting a fraction of its photons, at least
+   one if it shoots any.
+*/
+scene_t with_photon_fraction(scene_t s, float fraction) {
+  for (light_t& light : s.lights) {
+    if (light.photon_samples > 0u) {
+      light.photon_samples = std::max(unsigned(light.photon_samples *
+        fraction + 0.5f), 1u);
+    }
   }
-  return v;
+  s.photon_density *= fraction;
+  return s;
 }
 
-struct photon_hit {
-  vec3f position;
-  vec3f direction;
-  vec3f color;
-};
+/* Makes the photon map for an estimate, without saving it: the saved one,
+   if there is one, or else one of a fraction of the photons. Returns the
+   fraction of the photons it holds.
+*/
+float prepare_estimate_photon_map(const scene_t& s, const user_inputs& user,
+  thread_pool& pool)
+{
+  const char* cache_file = user.photon_cache_file;
+  if (s.integrator != PHOTON_INTEGRATOR) {
+    create_photon_map(s, pool);
+    return 1.f;
+  }
+  if (cache_file && load_photon_cache(cache_file, s, g_photon_map)) {
+    std::cout << "Loaded photon map from " << cache_file << std::endl;
+    return 1.f;
+  }
+  create_photon_map(with_photon_fraction(s, ESTIMATE_PHOTON_FRACTION), pool);
+  return ESTIMATE_PHOTON_FRACTION;
+}
 
-struct photon_hits {
-  photon_hits() = default;
-  photon_hits(size_t sphere_count, size_t mesh_count)
-    : sphere_hits(sphere_count)
-    , mesh_hits(mesh_count)
-  {}
+void record_irradiance(unsigned thread_id,
+  unsigned thread_count,
+  const scene_t& s,
+  std::vector<irradiance_record>& records)
+{
+  const vec3f screen_offset_per_px_x = s.screen_offset_per_px_x();
+  const vec3f screen_offset_per_px_y = s.screen_offset_per_px_y();
+  const unsigned stride = IRRADIANCE_PREPASS_STRIDE;
+  trace_context ctx;
+  ctx.irradiance_records = &records;
+  for (unsigned y = thread_id * stride; y < s.res.y;
+    y += thread_count * stride)
+  {
+    for (unsigned x = 0u; x < s.res.x; x += stride) {
+      ctx.pixel = y * s.res.x + x;
+      ctx.rng.seed(ctx.pixel);
+      vec3f pixel_pos = s.camera.screen_top_left +
+        (x + 0.5f) * screen_offset_per_px_x +
+        (y + 0.5f) * screen_offset_per_px_y;
+      ray_t eye_ray = { pixel_pos, normalized(pixel_pos - s.camera.observer) };
+      cast_ray(eye_ray, s, vec3f(0,0,0), ctx);
+    }
+  }
+}
 
-  std::vector<std::vector<photon_hit>> sphere_hits;
-  std::vector<std::vector<photon_hit>> mesh_hits;
-};
+/* Fills the irradiance cache from a sparse grid of pixels, before the
+   render reads it. The records are sorted by pixel, so the cache is the
+   same whatever the number of threads.
+*/
+void prepare_irradiance_cache(const scene_t& s, thread_pool& pool) {
+  if (s.irradiance_error <= 0.f || s.integrator != PHOTON_INTEGRATOR) {
+    return;
+  }
 
-photon_hits g_photon_hits;
+  std::vector<std::vector<irradiance_record>> thread_records(pool.size());
+  pool.run([&](unsigned thread_id) {
+    record_irradiance(thread_id, pool.size(), s, thread_records[thread_id]);
+  });
 
-// each object gets a vector of photons with a location, direction and color
-void add_to_sphere_photon_map(size_t obj_idx,
-  const vec3f& position, const vec3f& direction, const vec3f& energy) {
-  g_photon_hits.sphere_hits[obj_idx].push_back(
-    photon_hit{position, direction, energy});
+  std::vector<irradiance_record> records;
+  for (auto& r : thread_records) {
+    records.insert(records.end(), r.begin(), r.end());
+  }
+  std::stable_sort(records.begin(), records.end(),
+    [](const irradiance_record& lhs, const irradiance_record& rhs) {
+      return lhs.pixel < rhs.pixel;
+    });
+  g_irradiance_cache = irradiance_cache(s.irradiance_error);
+  g_irradiance_cache.build(std::move(records));
+  std::cout << "Irradiance records: " << g_irradiance_cache.size()
+    << std::endl;
 }
 
-void add_to_mesh_photon_map(size_t obj_idx,
-  const vec3f& position, const vec3f& direction, const vec3f& energy) {
-  g_photon_hits.mesh_hits[obj_idx].push_back(
-    photon_hit{position, direction, energy});
+void request_snapshot(int) {
+  g_snapshot_requested = 1;
 }
 
-void map_photon(const ray_t& ray, const scene_t& s, const vec3f& energy,
-  float refractive_index, bool indirect, unsigned int recursion_depth) {
-  ray_sphere_intersect rsi = get_ray_sphere_intersect(ray, s.geometry.spheres);
-  ray_mesh_intersect rmi = get_ray_mesh_intersect(ray, s.geometry.meshes);
-
-  nearest_t nearest =
-    nearest_intersect(rsi, s.geometry.spheres, rmi, s.geometry.meshes);
-  if (nearest == SPHERE_NEAREST) {
-    size_t sphere_idx = rsi.index_in(s.geometry.spheres);
-    material_t material = s.sphere_materials[sphere_idx];
-    if(material.opacity < 1.f) {
-      vec3f inside_pos = ray.position_at(rsi.t + BACKOFF);
-      vec3f normal = rsi.near_geometry_it->normal_at(inside_pos);
-      bool entering = true;
-      if (dot(ray.direction, normal) > 0.f) {
-        normal = -normal;
-        entering = false;
-      }
-      float new_refractive_index = entering ? material.refractive_index : 1.f;
-      ray_t refracted_ray = { inside_pos, refracted(ray.direction, normal,
-        refractive_index, new_refractive_index) };
-      if (recursion_depth < MAX_RECURSE) {
-        map_photon(refracted_ray, s, energy, new_refractive_index, true,
-          recursion_depth + 1u);
-      } else {
-        std::cerr << "Hit max recurse depth!" << std::endl;
-      }
-    // todo: handle reflective
-    } else if (indirect) {
-      add_to_sphere_photon_map(sphere_idx, ray.position_at(rsi.t), ray.direction, energy);
-    }
-  } else if (nearest == MESH_NEAREST) {
-    size_t mesh_idx = rmi.index_in(s.geometry.meshes);
-    material_t material = s.mesh_materials[mesh_idx];
-    if (material.opacity < 1.f) {
-      vec3f inside_pos = ray.position_at(rsi.t + BACKOFF);
-      vec3f normal = rmi.get_normal_at(inside_pos);
-      if (dot(ray.direction, normal) > 0.f) {
-        normal = -normal;
-      }
-      // todo: handle refractive index for leaving a volume
-      ray_t refracted_ray = { inside_pos, refracted(ray.direction, normal,
-        refractive_index, material.refractive_index) };
-      if (recursion_depth < MAX_RECURSE) {
-        map_photon(refracted_ray, s, energy, material.refractive_index, true,
-          recursion_depth + 1u);
-      } else {
-        std::cerr << "Hit max recurse depth!" << std::endl;
-      }
-    } else if (indirect) {
-      add_to_mesh_photon_map(mesh_idx, ray.position_at(rmi.t), ray.direction, energy);
-    }
-  }
+// stops the render gracefully, unless asked twice
+void request_stop(int signal) {
+  g_stop_requested = 1;
+  std::signal(signal, SIG_DFL);
 }
 
-void create_photon_map(const scene_t& s) {
-  g_photon_hits = photon_hits(s.geometry.spheres.size(), s.geometry.meshes.size());
-  if (!s.photon_mapping_enabled) {
+/* Adds the light gathered by progressive photon mapping, over the given
+   number of passes, to the pixels that saw it.
+*/
+void add_gathered_light(const scene_t& s,
+  const std::vector<gather_point>& points, unsigned passes,
+  const std::vector<unsigned>& sample_counts, image& img)
+{
+  if (passes == 0u) {
     return;
   }
-
-  std::mt19937 engine(123456789u);
-  std::uniform_real_distribution<float> distribution(-1.f, 1.f);
-  auto rng = std::bind(distribution, engine);
-
-  std::cout << "Creating photon map..." << std::endl;
-  std::cout << "Lights: " << s.lights.size() << std::endl;
-  for (const light_t& light : s.lights) {
-    float intensity = light.intensity;
-    size_t samples = light.photon_samples;
-    for (size_t i = 0; i < samples; ++i) {
-      // todo: sample only towards surfaces
-      ray_t ray = { light.position, random_downward_direction(rng) };
-      float refractive_index = 1.f;
-      unsigned int recursion_depth = 0u;
-      bool indirect = false;
-      vec3f energy = vec3f{1.f,1.f,1.f} * intensity / samples;
-      map_photon(ray, s, energy, refractive_index, indirect, recursion_depth);
-    }
+  for (const gather_point& point : points) {
+    vec3f light = gathered_light(point, s, passes);
+    img.px(point.pixel % s.res.x, point.pixel / s.res.x) +=
+      point.weight * light / sample_counts[point.pixel];
   }
-  std::cout << "Spheres: " << g_photon_hits.sphere_hits.size() << std::endl;
-  for (auto&& v : g_photon_hits.sphere_hits) {
-    std::cout << "Hits: " << v.size() << std::endl;
+}
+
+/* The file for a camera's output: the given one, with the name of the
+   camera, if it has one, added before the extension.
+*/
+std::string camera_file(const std::string& path, const camera_t& camera) {
+  if (camera.name.empty()) {
+    return path;
   }
-  std::cout << "Meshes: " << g_photon_hits.mesh_hits.size() << std::endl;
-  for (auto&& v : g_photon_hits.mesh_hits) {
-    std::cout << "Hits: " << v.size() << std::endl;
+  size_t extension = path.find_last_of('.');
+  size_t directory = path.find_last_of('/');
+  if (extension == std::string::npos ||
+    (directory != std::string::npos && extension < directory))
+  {
+    return path + "-" + camera.name;
   }
-  std::cout << "Finished photon map." << std::endl;
+  return path.substr(0u, extension) + "-" + camera.name +
+    path.substr(extension);
 }
 
-/* normal: normalized direction from surface outwards
-   to_light: normalized direction from surface to light
+/* Saves an image of the samples each pixel of the crop took, as a
+   fraction of the most a pixel could take.
 */
-float matte(vec3f normal, vec3f to_light) {
-  return std::max(dot(normal, to_light), 0.f);
+bool save_sample_map(const scene_t& s,
+  const std::vector<unsigned>& sample_counts, const char* path)
+{
+  image map(s.res.x, s.res.y);
+  size_t total = 0u;
+  for (size_t i = 0u; i < sample_counts.size(); ++i) {
+    float fraction = float(sample_counts[i]) / s.sample_count;
+    map.pixels[i] = vec3f(fraction, fraction, fraction);
+    total += sample_counts[i];
+  }
+  float crop_pixels = float(s.crop.width()) * s.crop.height();
+  std::cout << "Samples per pixel: " << total / crop_pixels
+    << " of " << s.sample_count << std::endl;
+  return output_image(map, s.crop, 0).save_as_png(path);
 }
 
-/* normal: normalized direction from surface outwards
-   to_light: normalized direction from surface to light
-   eye: normalized direction from eye to surface
-   n: the power to raise the specular component to (higher = shinier)
+/* The width of the terminal in characters, or DEFAULT_PREVIEW_WIDTH if
+   the output isn't a terminal.
 */
-float specular(vec3f normal, vec3f to_light, vec3f eye, float n) {
-  return std::pow(std::max(dot(eye, reflected(to_light, normal)), 0.f), n);
+unsigned preview_width() {
+  winsize size;
+  if (isatty(STDOUT_FILENO) && ioctl(STDOUT_FILENO, TIOCGWINSZ, &size) == 0 &&
+    size.ws_col > 0u)
+  {
+    return size.ws_col;
+  }
+  return DEFAULT_PREVIEW_WIDTH;
 }
 
-/* Casts a ray into the scene and returns a color.
-
-  The default_color is the color returned if no object is hit.
-
-  There are two possible cast_policy values, corresponding with
-  two main types of casts:
-  - cast-to-object:
-    intersection with a solid object results in a search for visible lights
-  - cast-to-light:
-    intersection with a solid object results in the conclusion that the point
-    is shadowed
-
-  Note that these casts do not account for indirect lighting,
-  i.e. global illumination
+/* Shows a quick preview of each camera before the render starts, on the
+   terminal, or in files named for the cameras.
 */
-vec3f cast_ray(const ray_t& ray,
-  const scene_t& s,
-  vec3f default_color,
-  cast_policy_t cast_policy,
-  float refractive_index,
-  unsigned recursion_depth)
+void show_previews(scene_t& scene, const std::vector<camera_t>& cameras,
+  const user_inputs& user, thread_pool& pool)
 {
-  vec3f color = default_color;
-
-  ray_sphere_intersect rsi = get_ray_sphere_intersect(ray, s.geometry.spheres);
-  ray_mesh_intersect rmi = get_ray_mesh_intersect(ray, s.geometry.meshes);
-
-  nearest_t nearest =
-    nearest_intersect(rsi, s.geometry.spheres, rmi, s.geometry.meshes);
-
-  if (nearest == SPHERE_NEAREST) {
-    material_t material = s.sphere_materials[rsi.index_in(s.geometry.spheres)];
-    float solid_component = material.opacity - material.reflectivity;
-    if (cast_policy == CAST_TO_OBJECT) {
-      vec3f pos = ray.position_at(rsi.t - BACKOFF);
-      vec3f material_color = material.texture ?
-        material.texture(pos) : material.color;
-
-      if (solid_component > 0.f) {
-        vec3f light_color(0,0,0);
-        bool is_shadowed = false;
-        for (const light_t& light : s.lights) {
-          ray_t light_ray = { pos, normalized(light.position - pos) };
-          vec3f one_light_color = cast_ray(light_ray, s, light.color,
-            CAST_TO_LIGHT, refractive_index, recursion_depth + 1u);
-          if (one_light_color == vec3f(0,0,0)) {
-            is_shadowed = true;
-          } else if (material.k_matte > 0.f || material.k_specular > 0.f) {
-            // phong shading
-            vec3f normal = rsi.near_geometry_it->normal_at(pos);
-            float matte_light = matte(normalized(normal), light_ray.direction);
-            float specular_light = specular(normalized(normal), light_ray.direction,
-              ray.direction, material.k_specular_n);
-            light_color += one_light_color *
-              (material.k_matte * matte_light +
-              material.k_specular * specular_light);
-          }
-          // normal / observer independant lighting
-          // it's fast and looks nice for some things
-          light_color += material.k_flat * one_light_color;
-        }
-        if (is_shadowed) {
-          // check photon map
-          vec3f intersect = ray.position_at(rsi.t);
-          // todo: do we need to account for the side we're on?
-          vec3f normal = normalized(rsi.near_geometry_it->normal_at(intersect));
-          size_t sphere_idx = rsi.index_in(s.geometry.spheres);
-          for (const photon_hit& photon : g_photon_hits.sphere_hits[sphere_idx]) {
-            float dist = magnitude(photon.position - intersect);
-            if (dist < 0.25f) {
-              dist *= 4;
-              float dist_sq = dist * dist;
-              light_color += photon.color *
-                (1.f - dist_sq) * matte(normal, -photon.direction);
-            }
-          }
-        }
-        // add the combined flat/specular/matte lights wih ambient light
-        color += solid_component * material_color * light_color;
-        color += solid_component * material_color * material.k_ambient * s.ambient_light;
-      }
-
-      if (material.reflectivity > 0.f) {
-        vec3f normal = rsi.near_geometry_it->normal_at(pos);
-        ray_t reflected_ray = { pos, reflected(ray.direction, normal) };
-        if (recursion_depth < MAX_RECURSE) {
-          color += material.reflectivity * material.color *
-            cast_ray(reflected_ray, s, default_color, cast_policy,
-            refractive_index, recursion_depth + 1u);
-        }
+  unsigned width = preview_width();
+  for (const camera_t& camera : cameras) {
+    scene.camera = camera;
+    image preview = render_preview(scene, width, pool);
+    if (user.previews) {
+      if (cameras.size() > 1u) {
+        std::cout << "Camera " << camera.name << std::endl;
       }
-
-      float translucence = 1.f - material.opacity;
-      if (translucence > 0.f) {
-        vec3f inside_pos = ray.position_at(rsi.t + BACKOFF);
-        vec3f normal = rsi.near_geometry_it->normal_at(inside_pos);
-        if (dot(ray.direction, normal) > 0.f) {
-          normal = -normal;
-        }
-        ray_t refracted_ray = { inside_pos, refracted(ray.direction, normal,
-          refractive_index, material.refractive_index) };
-        if (recursion_depth < MAX_RECURSE) {
-          color += translucence * material.color * cast_ray(refracted_ray, s,
-            default_color, cast_policy, material.refractive_index,
-            recursion_depth + 1u);
-        } else {
-          std::cerr << "Hit max recurse depth!" << std::endl;
-        }
-      }
-
-    } else { // cast_policy == CAST_TO_LIGHT
-      // We hit an object while looking for our light.
-      // That means we're shadowed...
-      color = vec3f(0,0,0);
-      // unless we have caustics!
+      preview.print_as_ansi(std::cout);
     }
-  } else if (nearest == MESH_NEAREST) {
-
-    // todo: reduce duplication between sphere and mesh color calculations
-
-    material_t material = s.mesh_materials[rmi.index_in(s.geometry.meshes)];
-    float solid_component = material.opacity - material.reflectivity;
-    if (cast_policy == CAST_TO_OBJECT) {
-      vec3f pos = ray.position_at(rmi.t - BACKOFF);
-      vec3f material_color = material.texture ?
-        material.texture(pos) : material.color;
-
-      if (solid_component > 0.f) {
-        vec3f light_color(0,0,0);
-        bool is_shadowed = false;
-        for (const light_t& light : s.lights) {
-          ray_t light_ray = { pos, normalized(light.position - pos) };
-          vec3f one_light_color = cast_ray(light_ray, s, light.color,
-            CAST_TO_LIGHT, refractive_index, recursion_depth + 1u);
-          if (one_light_color == vec3f(0,0,0)) {
-            is_shadowed = true;
-          } else if (material.k_matte > 0.f || material.k_specular > 0.f) {
-            // phong shading
-            vec3f normal = rmi.get_normal_at(pos);
-            float matte_light = matte(normal, light_ray.direction);
-            float specular_light = specular(normal, light_ray.direction, ray.direction,
-                                            material.k_specular_n);
-            light_color += one_light_color *
-              (material.k_matte * matte_light +
-              material.k_specular * specular_light);
-          }
-          // normal / observer independant lighting
-          // it's fast and looks nice for some things
-          light_color += material.k_flat * one_light_color;
-        }
-        if (is_shadowed) {
-          // check photon map
-          vec3f intersect = ray.position_at(rmi.t);
-          vec3f normal = normalized(rmi.get_normal_at(intersect));
-          size_t mesh_idx = rmi.index_in(s.geometry.meshes);
-          for (const photon_hit& photon : g_photon_hits.mesh_hits[mesh_idx]) {
-            float dist = magnitude(photon.position - intersect);
-            if (dist < 0.25f) {
-              dist *= 4;
-              float dist_sq = dist * dist;
-              light_color += photon.color *
-                sqrt(1.f - dist_sq) * matte(normal, -photon.direction);
-            }
-          }
-        }
-        color += solid_component * material_color * light_color;
-        color += solid_component * material_color * material.k_ambient * s.ambient_light;
+    if (user.preview_file) {
+      const std::string preview_file = camera_file(user.preview_file, camera);
+      if (!preview.save_as_png(preview_file.c_str())) {
+        std::cerr << "Failed to save preview to " << preview_file
+          << std::endl;
       }
-
-      if (material.reflectivity > 0.f) {
-        vec3f normal = rmi.get_normal_at(pos);
-        ray_t reflected_ray = { pos, reflected(ray.direction, normal) };
-        if (recursion_depth < MAX_RECURSE) {
-          color += material.reflectivity * material.color *
-            cast_ray(reflected_ray, s, default_color, cast_policy,
-            refractive_index, recursion_depth + 1u);
-        }
-      }
-
-      float translucence = 1.f - material.opacity;
-      if (translucence > 0.f) {
-        vec3f inside_pos = ray.position_at(rsi.t + BACKOFF);
-        vec3f normal = rmi.get_normal_at(inside_pos);
-        if (dot(ray.direction, normal) > 0.f) {
-          normal = -normal;
-        }
-        ray_t refracted_ray = { inside_pos, refracted(ray.direction, normal,
-          refractive_index, material.refractive_index) };
-        if (recursion_depth < MAX_RECURSE) {
-          color += translucence * material.color * cast_ray(refracted_ray, s,
-            default_color, cast_policy, material.refractive_index,
-            recursion_depth + 1u);
-        } else {
-          std::cerr << "Hit max recurse depth!" << std::endl;
-        }
-      }
-
-    } else { // cast_policy == CAST_TO_LIGHT
-      // shadowed...
-      color = vec3f(0,0,0);
     }
-
   }
-  return color;
+  scene.camera = cameras.front();
 }
 
-void generate_pixels(unsigned thread_id,
-  unsigned thread_count,
-  const scene_t& s,
-  const vec3f& screen_offset_per_px_x,
-  const vec3f& screen_offset_per_px_y,
-  bool display_progress,
-  image& img)
+double seconds_since(std::chrono::steady_clock::time_point start) {
+  std::chrono::duration<double> elapsed =
+    std::chrono::steady_clock::now() - start;
+  return elapsed.count();
+}
+
+/* Measures what rendering a sample of each camera's pixels takes, once the
+   photon map is ready with the given fraction of the photons, along with
+   preparing the irradiance cache and a fraction of a pass of progressive
+   photon mapping for it.
+*/
+job_estimate estimate_job(scene_t& scene, const std::vector<camera_t>& cameras,
+  const render_options& options, thread_pool& pool, float photon_fraction)
 {
-  for (unsigned y = thread_id; y < s.res.y; y += thread_count) {
-    std::mt19937 engine(y);
-    std::uniform_real_distribution<float> distribution(0.f, 1.f);
-    auto rng = std::bind(distribution, engine);
-    for (unsigned x = 0u; x < s.res.x; ++x) {
-      vec3f px_color = { 0, 0, 0 };
-      for (unsigned sample = 0u; sample < s.sample_count; ++sample) {
-        vec3f background_color = { 0, 0, 0 };
-        vec3f pixel_pos = s.screen_top_left +
-          (x + rng()) * screen_offset_per_px_x +
-          (y + rng()) * screen_offset_per_px_y;
-        ray_t eye_ray = { pixel_pos, normalized(pixel_pos - s.observer) };
-        px_color += cast_ray(eye_ray, s, background_color,
-          CAST_TO_OBJECT, 1.f, 0u);
-      }
-      img.px(x, y) = px_color / s.sample_count;
+  job_estimate job;
+  job.thread_count = pool.size();
+  job.node_count = pool.node_count();
+  job.photon_fraction = photon_fraction;
+  for (const camera_t& camera : cameras) {
+    scene.camera = camera;
+    camera_estimate estimate;
+    estimate.name = camera.name;
+    estimate.pixel_count = size_t(scene.crop.width()) * scene.crop.height();
+    std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+    prepare_irradiance_cache(scene, pool);
+    estimate.irradiance_seconds = seconds_since(start);
+
+    bool gathers_photons = scene.integrator == PROGRESSIVE_PHOTON_INTEGRATOR;
+    std::vector<gather_point> gather_points;
+    estimate.sample = sample_render(scene, options, pool, ESTIMATE_PIXELS,
+      gathers_photons ? &gather_points : 0);
+    estimate.gather_point_count = gather_points.size();
+    if (scene.integrator == PHOTON_INTEGRATOR &&
+      scene.photon_neighbors == 0u)
+    {
+      // each gather finds every photon within the radius, so the full map
+      // makes them that many times longer; the nearest ones take about
+      // as long from any map
+      estimate.gather_scale = 1. / photon_fraction;
     }
-    if (thread_id == 0 && display_progress) {
-      float current_progress = 100.f * float(y) / s.res.y;
-      float previous_progress = 100.f * (float(y) - 1) / s.res.y;
-      if (std::floor(current_progress) != std::floor(previous_progress)) {
-        std::cout << current_progress << "%" << std::endl;
-      }
+    if (gathers_photons) {
+      // every pass shoots as many photons, but only the sample gathers
+      // them, from a fraction of a pass
+      scene_t one_pass = with_photon_fraction(scene,
+        ESTIMATE_PHOTON_FRACTION);
+      one_pass.photon_passes = 1u;
+      start = std::chrono::steady_clock::now();
+      trace_progressive_photons(one_pass, gather_points, pool,
+        []{ return false; });
+      estimate.photon_pass_seconds = seconds_since(start) /
+        ESTIMATE_PHOTON_FRACTION;
+      estimate.photon_passes = scene.photon_passes;
     }
+    estimate.buffer_bytes = render_buffer_bytes(scene, options);
+    job.cameras.push_back(estimate);
   }
+  scene.camera = cameras.front();
+  job.prepared_bytes = resident_bytes();
+  return job;
 }
 
-image generate_image(const scene_t& s, unsigned thread_count,
-  bool display_progress)
+/* Renders the scene's camera, saving its output and sample map to files
+   named for it. Returns the exit code, if it fails.
+*/
+int render_camera(const scene_t& scene, const user_inputs& user,
+  render_options options, thread_pool& pool, const char* program)
 {
-  const vec3f screen_offset_per_px_x = s.screen_offset_per_px_x();
-  const vec3f screen_offset_per_px_y = s.screen_offset_per_px_y();
-
-  image img(s.res.x, s.res.y);
-  std::vector<std::thread> threads(thread_count);
-
-  for (unsigned thread_id = 0u; thread_id < threads.size(); ++thread_id) {
-    threads[thread_id] = std::thread(std::bind(generate_pixels, thread_id,
-      thread_count,
-      std::cref(s),
-      std::cref(screen_offset_per_px_x),
-      std::cref(screen_offset_per_px_y),
-      display_progress,
-      std::ref(img)));
+  bool coordinates = user.worker_count > 0u || user.queue_dir;
+  if (!coordinates) {
+    // the cache is of what the camera sees
+    prepare_irradiance_cache(scene, pool);
   }
-
-  for (auto& thread : threads) {
-    thread.join();
+  const std::string output_file = camera_file(
+    get_with_default(user.output_file, "output.png"), scene.camera);
+  // a resumed render keeps checkpointing to the file it resumed from
+  options.checkpoint_file = get_with_default(user.checkpoint_file,
+    user.resume_file);
+  if (user.progressive) {
+    // snapshots replace the output until the render finishes
+    options.snapshot_file = output_file.c_str();
   }
 
-  return img;
+  bool gathers_photons = scene.integrator == PROGRESSIVE_PHOTON_INTEGRATOR;
+  std::vector<gather_point> gather_points;
+  accumulation_buffer buffer(scene.res.x, scene.res.y);
+  bool stopped_early = false;
+  if (user.resume_file && !load_checkpoint(user.resume_file,
+    render_key(scene, user.tile_size), options.passes_done, buffer,
+    gathers_photons ? &gather_points : 0))
+  {
+    std::cerr << "Failed to resume from " << user.resume_file
+      << ": missing, or saved from a different scene or settings"
+      << std::endl;
+    return EXIT_FAIL_LOAD;
+  }
+  if (coordinates) {
+    distributed_options distributed;
+    distributed.worker_count = user.worker_count;
+    distributed.queue_dir = user.queue_dir;
+    distributed.job_size = user.job_size;
+    distributed.worker_command = worker_command(user, scene.camera,
+      pool.size(), program);
+    if (!render_distributed(scene, options, distributed, buffer,
+      gathers_photons ? &gather_points : 0))
+    {
+      std::cerr << "Distributed render failed" << std::endl;
+      return EXIT_FAIL_SAVE;
+    }
+  } else if (!render_image(scene, options, pool, buffer,
+    gathers_photons ? &gather_points : 0))
+  {
+    stopped_early = true;
+    std::cout << "Stopped rendering early, with noise " << image_noise(buffer,
+      scene.crop) << std::endl;
+  }
+  image img = buffer.average();
+  if (gathers_photons) {
+    // the photon passes stop with the render, after the first, so the
+    // image still has the light they gather
+    unsigned passes = trace_progressive_photons(scene, gather_points, pool,
+      [&]{ return stopped_early || should_stop(options); });
+    add_gathered_light(scene, gather_points, passes, buffer.sample_counts,
+      img);
+  }
+  if (user.sample_map_file) {
+    const std::string sample_map_file = camera_file(user.sample_map_file,
+      scene.camera);
+    if (!save_sample_map(scene, buffer.sample_counts,
+      sample_map_file.c_str()))
+    {
+      std::cerr << "Failed to save sample map to " << sample_map_file
+        << std::endl;
+    }
+  }
+  img.clamp_colors();
+  if (!output_image(img, scene.crop, options.backdrop).save_as_png(
+    output_file.c_str()))
+  {
+    return EXIT_FAIL_SAVE;
+  }
+  return EXIT_OK;
 }
 
 int main(int argc, char** argv) {
+  const std::chrono::steady_clock::time_point start =
+    std::chrono::steady_clock::now();
   user_inputs user = parse_inputs(argc, argv);
   if (user.requests_help) {
     std::cout << help_text << std::endl;
@@ -574,16 +742,153 @@ int main(int argc, char** argv) {
     std::cout << scene_file_help_text << std::endl;
     std::exit(EXIT_OK);
   }
+  std::streambuf* standard_output = std::cout.rdbuf();
+  if (user.estimates) {
+    // only the estimate goes to the standard output
+    std::cout.rdbuf(std::cerr.rdbuf());
+  }
+  const size_t startup_bytes = user.estimates ? resident_bytes() : 0u;
+  // estimates are of rendering in this process
+  bool coordinates = !user.estimates &&
+    (user.worker_count > 0u || user.queue_dir);
+  if (coordinates && (user.progressive || user.checkpoint_file ||
+    user.resume_file || user.time_limit > 0.f || user.target_noise > 0.f))
+  {
+    std::cerr << "Distributed renders don't support progressive rendering, "
+      "checkpoints or limits" << std::endl;
+    return EXIT_BAD_ARGS;
+  }
+  FILE* job_results = 0;
+  if (user.serves_pipe) {
+    // results go back on the real standard output, and messages nowhere
+    job_results = fdopen(dup(STDOUT_FILENO), "wb");
+    if (!job_results || !std::freopen("/dev/null", "w", stdout)) {
+      return EXIT_FAIL_SAVE;
+    }
+  }
 
-  const scene_t scene = try_load_scene_from_file(
+  scene_t scene = try_load_scene_from_file(
     get_with_default(user.scene_file, "world.yml"), EXIT_FAIL_LOAD);
-  create_photon_map(scene);
+  if (user.overrides_sampler) {
+    scene.sampler = user.sampler;
+  }
+  if (user.overrides_crop) {
+    if (!user.crop.fits(scene.res)) {
+      std::cerr << "The crop must be a non-empty part of the "
+        << scene.res.x << "x" << scene.res.y << " image" << std::endl;
+      return EXIT_BAD_ARGS;
+    }
+    scene.crop = user.crop;
+  }
+  std::vector<camera_t> cameras = scene.cameras;
+  if (user.camera_name) {
+    auto named = std::find_if(cameras.begin(), cameras.end(),
+      [&](const camera_t& camera) {
+        return camera.name == user.camera_name;
+      });
+    if (named == cameras.end()) {
+      std::cerr << "The scene has no camera named " << user.camera_name
+        << std::endl;
+      return EXIT_BAD_ARGS;
+    }
+    cameras.assign(1u, *named);
+  }
+  if (cameras.size() > 1u && (user.checkpoint_file || user.resume_file)) {
+    std::cerr << "Checkpoints hold one camera's render, so choose one of "
+      "the scene's cameras with --camera" << std::endl;
+    return EXIT_BAD_ARGS;
+  }
+  scene.camera = cameras.front();
+  image backdrop(0u, 0u);
+  if (user.composite_file && (!backdrop.load_from_png(user.composite_file) ||
+    backdrop.width() != scene.res.x || backdrop.height() != scene.res.y))
+  {
+    std::cerr << "Failed to load " << user.composite_file << " as a "
+      << scene.res.x << "x" << scene.res.y << " image" << std::endl;
+    return EXIT_FAIL_LOAD;
+  }
+  cpu_topology topology = read_cpu_topology();
+  thread_pool pool(user.thread_count ? user.thread_count :
+    topology.cpu_count(), user.pins_threads, topology);
+  if ((user.previews || user.preview_file) && !user.serves_pipe &&
+    !user.serve_queue_dir)
+  {
+    show_previews(scene, cameras, user, pool);
+  }
+  const size_t loaded_bytes = user.estimates ? resident_bytes() : 0u;
+  const size_t scene_bytes = loaded_bytes - std::min(startup_bytes,
+    loaded_bytes);
+  std::chrono::steady_clock::time_point photon_map_start =
+    std::chrono::steady_clock::now();
+  float photon_fraction = 1.f;
+  if (user.estimates) {
+    // quicker than the render's, and leaving the photon cache alone
+    photon_fraction = prepare_estimate_photon_map(scene, user, pool);
+  } else if (!coordinates) {
+    // workers prepare their own, and the cameras share it
+    prepare_photon_map(scene, user, pool);
+  }
+  double photon_map_seconds = seconds_since(photon_map_start);
+  const size_t photon_map_bytes = user.estimates ? resident_bytes() -
+    std::min(loaded_bytes, resident_bytes()) : 0u;
+
+  render_options options;
+  options.tile_size = user.tile_size;
+  options.display_progress = user.display_progress;
+  options.progressive = user.progressive;
+  options.snapshot_interval = user.snapshot_interval;
+  options.checkpoint_interval = user.checkpoint_interval;
+  options.target_noise = user.target_noise;
+  options.backdrop = user.composite_file ? &backdrop : 0;
+  if (user.time_limit > 0.f) {
+    // the limit is on the whole job, including preparing photon maps
+    options.deadline = start +
+      std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<float>(user.time_limit));
+  }
+  if (user.progressive) {
+    std::signal(SIGUSR1, request_snapshot);
+  }
+  if (user.serves_pipe) {
+    prepare_irradiance_cache(scene, pool);
+    return serve_pipe_jobs(scene, options, pool, stdin, job_results) ?
+      EXIT_OK : EXIT_FAIL_SAVE;
+  } else if (user.serve_queue_dir) {
+    prepare_irradiance_cache(scene, pool);
+    return serve_job_queue(scene, options, pool, user.serve_queue_dir) ?
+      EXIT_OK : EXIT_FAIL_LOAD;
+  }
 
-  image img = generate_image(scene, user.thread_count, user.display_progress);
-  img.clamp_colors();
-  if (!img.save_as_png(get_with_default(user.output_file, "output.png"))) {
-    return EXIT_FAIL_SAVE;
+  if (user.estimates) {
+    job_estimate job = estimate_job(scene, cameras, options, pool,
+      photon_fraction);
+    job.photon_map_seconds = photon_map_seconds;
+    job.photon_map_bytes = photon_map_bytes;
+    job.scene_bytes = scene_bytes;
+    std::cout.rdbuf(standard_output);
+    write_estimate_json(job, std::cout);
+    return EXIT_OK;
+  }
+
+  std::signal(SIGINT, request_stop);
+  std::signal(SIGTERM, request_stop);
+  for (size_t i = 0u; i < cameras.size(); ++i) {
+    scene.camera = cameras[i];
+    if (cameras.size() > 1u) {
+      std::cout << "Camera " << scene.camera.name << std::endl;
+    }
+    int status = render_camera(scene, user, options, pool, argv[0]);
+    if (status != EXIT_OK) {
+      return status;
+    }
+    if (i + 1u < cameras.size() && (g_stop_requested ||
+      std::chrono::steady_clock::now() >= options.deadline))
+    {
+      std::cout << "Stopped before rendering the remaining cameras"
+        << std::endl;
+      break;
+    }
   }
-  
+
   return EXIT_OK;
 }
@@ -0,0 +1,233 @@
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "content_hash.h"
+#include "photon_cache.h"
+
+namespace {
+
+// bump when the file layout, or how photons are traced, changes
+const uint32_t PHOTON_CACHE_VERSION = 7u;
+const char PHOTON_CACHE_MAGIC[8] = { 'R','A','Y','P','H','O','T','\0' };
+
+/* The file is this header, the photon count and quantization box of each
+   tree (spheres, then meshes), then the map's photons and split axes
+   arrays as they are held in memory.
+*/
+struct photon_cache_header {
+  char magic[8];
+  uint32_t version;
+  uint32_t tree_count;
+  uint64_t key;
+};
+
+void add_material(content_hash& hash, const material_t& material) {
+  hash.add(material.opacity);
+  hash.add(material.refractive_index);
+}
+
+typedef std::unique_ptr<FILE,int(*)(FILE*)> unique_file_ptr;
+
+int null_friendly_fclose(FILE* file) {
+  if (!file) {
+    return 0;
+  }
+  fclose(file);
+  return 0;
+}
+
+// a read-only view of a whole file
+class mapped_file {
+public:
+  explicit mapped_file(const char* file)
+    : data_(MAP_FAILED)
+    , size_(0u)
+  {
+    int fd = open(file, O_RDONLY);
+    if (fd < 0) {
+      return;
+    }
+    struct stat info;
+    if (fstat(fd, &info) == 0 && info.st_size > 0) {
+      size_ = info.st_size;
+      data_ = mmap(0, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+  }
+
+  ~mapped_file() {
+    if (data_ != MAP_FAILED) {
+      munmap(data_, size_);
+    }
+  }
+
+  mapped_file(const mapped_file&) = delete;
+  mapped_file& operator=(const mapped_file&) = delete;
+
+  const char* data() const {
+    return data_ == MAP_FAILED ? 0 : static_cast<const char*>(data_);
+  }
+
+  size_t size() const {
+    return data_ == MAP_FAILED ? 0u : size_;
+  }
+
+private:
+  void* data_;
+  size_t size_;
+};
+
+std::vector<const photon_tree*> trees_of(const photon_map& map) {
+  std::vector<const photon_tree*> trees;
+  for (const photon_tree& tree : map.sphere_photons) {
+    trees.push_back(&tree);
+  }
+  for (const photon_tree& tree : map.mesh_photons) {
+    trees.push_back(&tree);
+  }
+  return trees;
+}
+
+bool write_all(FILE* file, const void* data, size_t size) {
+  return size == 0u || fwrite(data, size, 1u, file) == 1u;
+}
+
+} // namespace
+
+uint64_t photon_map_key(const scene_t& s) {
+  content_hash hash;
+  hash.add(PHOTON_CACHE_VERSION);
+  for (const sphere_t& sphere : s.geometry.spheres) {
+    hash.add(sphere.center);
+    hash.add(sphere.radius_squared);
+  }
+  for (const mesh_t& mesh : s.geometry.meshes) {
+    hash.add(mesh.vertexes);
+    hash.add(mesh.indexes);
+    hash.add(mesh.vertex_normals);
+    hash.add(mesh.face_normals);
+    hash.add(mesh.smooth);
+  }
+  for (const material_t& material : s.sphere_materials) {
+    add_material(hash, material);
+  }
+  for (const material_t& material : s.mesh_materials) {
+    add_material(hash, material);
+  }
+  for (const light_link_t& links : s.sphere_light_links) {
+    hash.add(links.mask);
+  }
+  for (const light_link_t& links : s.mesh_light_links) {
+    hash.add(links.mask);
+  }
+  hash.add(s.photon_density);
+  hash.add(uint32_t(s.sampler));
+  for (const light_t& light : s.lights) {
+    hash.add(light.position);
+    hash.add(light.intensity);
+    hash.add(light.photon_samples);
+    hash.add(light.share_index);
+    hash.add(light.share_count);
+    hash.add(light.influence_radius);
+  }
+  return hash.value();
+}
+
+bool load_photon_cache(const char* file, const scene_t& s, photon_map& map) {
+  mapped_file mapping(file);
+  const char* data = mapping.data();
+  size_t size = mapping.size();
+
+  photon_cache_header header;
+  if (size < sizeof(header)) {
+    return false;
+  }
+  memcpy(&header, data, sizeof(header));
+  size_t sphere_count = s.geometry.spheres.size();
+  size_t tree_count = sphere_count + s.geometry.meshes.size();
+  if (memcmp(header.magic, PHOTON_CACHE_MAGIC, sizeof(header.magic)) ||
+      header.version != PHOTON_CACHE_VERSION ||
+      header.tree_count != tree_count ||
+      header.key != photon_map_key(s)) {
+    return false;
+  }
+
+  size_t offset = sizeof(header);
+  if (size - offset < tree_count * sizeof(uint64_t)) {
+    return false;
+  }
+  std::vector<uint64_t> counts(tree_count);
+  memcpy(counts.data(), data + offset, tree_count * sizeof(uint64_t));
+  offset += tree_count * sizeof(uint64_t);
+
+  if (size - offset < tree_count * sizeof(photon_position)) {
+    return false;
+  }
+  std::vector<photon_position> boxes(tree_count);
+  memcpy(boxes.data(), data + offset, tree_count * sizeof(photon_position));
+  offset += tree_count * sizeof(photon_position);
+
+  uint64_t total = 0u;
+  for (uint64_t count : counts) {
+    total += count;
+  }
+  if ((size - offset) / (sizeof(photon_hit) + 1u) != total ||
+      (size - offset) % (sizeof(photon_hit) + 1u) != 0u) {
+    return false;
+  }
+
+  photon_map loaded;
+  loaded.photons.resize(total);
+  loaded.axes.resize(total);
+  memcpy(loaded.photons.data(), data + offset, total * sizeof(photon_hit));
+  offset += total * sizeof(photon_hit);
+  memcpy(loaded.axes.data(), data + offset, total);
+  index_photon_map(s, std::vector<size_t>(counts.begin(), counts.end()),
+    boxes, loaded);
+  map = std::move(loaded);
+  return true;
+}
+
+bool save_photon_cache(const char* file, const scene_t& s,
+  const photon_map& map)
+{
+  // write beside the destination, so readers never see a partial file
+  std::string temporary = std::string(file) + ".tmp";
+  unique_file_ptr fp(fopen(temporary.c_str(), "wb"), &null_friendly_fclose);
+  if (!fp) {
+    return false;
+  }
+
+  std::vector<const photon_tree*> trees = trees_of(map);
+  photon_cache_header header;
+  memcpy(header.magic, PHOTON_CACHE_MAGIC, sizeof(header.magic));
+  header.version = PHOTON_CACHE_VERSION;
+  header.tree_count = trees.size();
+  header.key = photon_map_key(s);
+
+  std::vector<uint64_t> counts;
+  std::vector<photon_position> boxes;
+  for (const photon_tree* tree : trees) {
+    counts.push_back(tree->size());
+    boxes.push_back(tree->position());
+  }
+  bool ok = write_all(fp.get(), &header, sizeof(header)) &&
+    write_all(fp.get(), counts.data(), counts.size() * sizeof(uint64_t)) &&
+    write_all(fp.get(), boxes.data(), boxes.size() * sizeof(photon_position));
+  ok = ok && write_all(fp.get(), map.photons.data(),
+    map.photons.size() * sizeof(photon_hit)) &&
+    write_all(fp.get(), map.axes.data(), map.axes.size());
+  ok = fflush(fp.get()) == 0 && ok;
+  fp.reset();
+
+  if (!ok || rename(temporary.c_str(), file) != 0) {
+    remove(temporary.c_str());
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,26 @@
+#ifndef PHOTON_CACHE_H
+#define PHOTON_CACHE_H
+
+#include <cstdint>
+#include "photon_map.h"
+#include "scene.h"
+
+/* A hash of everything in the scene that changes where photons land:
+   the geometry, how materials transmit light, the lights, and their links.
+*/
+uint64_t photon_map_key(const scene_t& s);
+
+/* Loads the photon map saved for this scene into map. Returns false,
+   leaving map untouched, if the file is missing or was saved for a
+   different scene.
+*/
+bool load_photon_cache(const char* file, const scene_t& s, photon_map& map);
+
+/* Saves the photon map for this scene. The file holds the photon array
+   with the kd-trees in their built layout, so loading it is a copy out of
+   the mapped file.
+*/
+bool save_photon_cache(const char* file, const scene_t& s,
+  const photon_map& map);
+
+#endif
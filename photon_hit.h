@@ -0,0 +1,140 @@
+#ifndef PHOTON_HIT_H
+#define PHOTON_HIT_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include "vec3f.h"
+
+/* The box a photon's position is quantized within, the bounds of all the
+   photons on the same object. Also the Position function of photon trees.
+*/
+struct photon_position {
+  photon_position()
+    : lower(0,0,0)
+    , step(0,0,0)
+  {
+  }
+
+  photon_position(const vec3f& lower, const vec3f& upper)
+    : lower(lower)
+    , step((upper - lower) / 65535.f)
+  {
+  }
+
+  uint16_t quantize(const vec3f& position, size_t axis) const {
+    if (step[axis] <= 0.f) {
+      return 0u;
+    }
+    float q = (position[axis] - lower[axis]) / step[axis];
+    return uint16_t(std::min(std::max(q + 0.5f, 0.f), 65535.f));
+  }
+
+  template<class T>
+  vec3f operator()(const T& photon) const {
+    return vec3f(lower[0] + photon.position[0] * step[0],
+      lower[1] + photon.position[1] * step[1],
+      lower[2] + photon.position[2] * step[2]);
+  }
+
+  vec3f lower;
+  vec3f step;
+};
+
+/* A photon that landed on a surface, packed into 12 bytes:
+   its position as 16 bits per axis within a photon_position box,
+   its direction of travel octahedrally encoded in a byte per coordinate,
+   and its energy as RGBE, three 8-bit mantissas sharing an exponent.
+*/
+struct photon_hit {
+  // the position is left for place, once the box is known
+  static photon_hit pack(const vec3f& direction, const vec3f& color);
+
+  void place(const photon_position& box, const vec3f& position);
+
+  vec3f direction() const;
+  vec3f color() const;
+
+  uint16_t position[3];
+  uint8_t encoded_direction[2];
+  uint8_t encoded_color[4];
+};
+
+namespace photon_encoding {
+
+inline float sign_of(float x) {
+  return x < 0.f ? -1.f : 1.f;
+}
+
+inline uint8_t unorm8(float x) {
+  return uint8_t(std::min(std::max((x + 1.f) * 127.5f + 0.5f, 0.f), 255.f));
+}
+
+} // namespace photon_encoding
+
+inline photon_hit photon_hit::pack(const vec3f& direction,
+  const vec3f& color)
+{
+  using namespace photon_encoding;
+  photon_hit photon;
+  std::fill(photon.position, photon.position + 3, 0u);
+
+  // project onto the octahedron, folding the lower half over the upper
+  float l1 = std::abs(direction[0]) + std::abs(direction[1]) +
+    std::abs(direction[2]);
+  float u = direction[0] / l1;
+  float v = direction[1] / l1;
+  if (direction[2] < 0.f) {
+    float folded_u = (1.f - std::abs(v)) * sign_of(u);
+    v = (1.f - std::abs(u)) * sign_of(v);
+    u = folded_u;
+  }
+  photon.encoded_direction[0] = unorm8(u);
+  photon.encoded_direction[1] = unorm8(v);
+
+  float brightest = std::max({color[0], color[1], color[2]});
+  if (brightest < 1e-32f) {
+    std::fill(photon.encoded_color, photon.encoded_color + 4, 0u);
+  } else {
+    int exponent;
+    float mantissa = std::frexp(brightest, &exponent) * 256.f / brightest;
+    for (size_t i = 0u; i < 3u; ++i) {
+      photon.encoded_color[i] = uint8_t(std::max(color[i], 0.f) * mantissa);
+    }
+    photon.encoded_color[3] = uint8_t(exponent + 128);
+  }
+  return photon;
+}
+
+inline void photon_hit::place(const photon_position& box,
+  const vec3f& position)
+{
+  for (size_t axis = 0u; axis < 3u; ++axis) {
+    this->position[axis] = box.quantize(position, axis);
+  }
+}
+
+inline vec3f photon_hit::direction() const {
+  using namespace photon_encoding;
+  float u = encoded_direction[0] / 127.5f - 1.f;
+  float v = encoded_direction[1] / 127.5f - 1.f;
+  float w = 1.f - std::abs(u) - std::abs(v);
+  if (w < 0.f) {
+    float unfolded_u = (1.f - std::abs(v)) * sign_of(u);
+    v = (1.f - std::abs(u)) * sign_of(v);
+    u = unfolded_u;
+  }
+  return normalized(vec3f(u, v, w));
+}
+
+inline vec3f photon_hit::color() const {
+  if (encoded_color[3] == 0u) {
+    return vec3f(0,0,0);
+  }
+  float scale = std::ldexp(1.f, int(encoded_color[3]) - (128 + 8));
+  return vec3f((encoded_color[0] + 0.5f) * scale,
+    (encoded_color[1] + 0.5f) * scale,
+    (encoded_color[2] + 0.5f) * scale);
+}
+
+#endif
@@ -0,0 +1,505 @@
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <cmath>
+#include <iostream>
+#include "photon_map.h"
+#include "random.h"
+#include "sampler.h"
+#include "trace.h"
+
+photon_map g_photon_map;
+
+void index_photon_map(const scene_t& s, const std::vector<size_t>& counts,
+  const std::vector<photon_position>& boxes, photon_map& map)
+{
+  map.sphere_photons.clear();
+  map.mesh_photons.clear();
+  size_t first = 0u;
+  for (size_t i = 0u; i < counts.size(); ++i) {
+    photon_tree tree(map.photons.data() + first, map.axes.data() + first,
+      counts[i], boxes[i]);
+    if (i >= s.geometry.spheres.size()) {
+      map.mesh_photons.push_back(tree);
+    } else {
+      map.sphere_photons.push_back(tree);
+    }
+    first += counts[i];
+  }
+}
+
+namespace {
+
+// takes two random numbers [0..1] and returns a random direction
+//vec3f random_direction(float x1, float x2) {
+//  const float TWO_PI = 2 * M_PI;
+//  x2 = 2 * x2 - 1; // [-1..1]
+//  return vec3f(sin(TWO_PI * x1), cos(TWO_PI * x1), 2*asin(x2)/M_PI);
+//}
+
+/* A direction in the lower hemisphere, chosen evenly by solid angle. Its
+   height is uniform, as on any sphere, so two numbers are enough, and
+   evenly spread numbers give evenly spread directions.
+*/
+template<class T>
+vec3f random_downward_direction(T& rng) {
+  float y = -rng();
+  float r = std::sqrt(std::max(0.f, 1.f - y * y));
+  float phi = 2.f * float(M_PI) * rng();
+  return vec3f(r * std::cos(phi), y, r * std::sin(phi));
+}
+
+/* A cone of directions from a light that encloses the bounding sphere of
+   a translucent object.
+*/
+struct emission_target {
+  vec3f axis;
+  float cos_max; // the cosine of the cone's half angle
+  float solid_angle;
+  float probability; // of aiming a photon at this target
+};
+
+/* Where a light emits its photons (Jensen's projection maps). Photons are
+   only stored after passing through translucent objects, so only those
+   aimed at them are traced. A target is picked in proportion to its
+   silhouette area, then a direction within its cone, and the photon's
+   energy is scaled by how much likelier that direction was than when
+   emitting evenly downwards, so the map converges to the same result.
+*/
+struct projection_map {
+  std::vector<emission_target> targets;
+  bool emits_everywhere; // the light is inside a target's bounds
+  size_t photon_count;
+};
+
+// the probability density of a direction when emitting evenly downwards
+const float DOWNWARD_PDF = float(0.5 / M_PI);
+
+projection_map create_projection_map(const scene_t& s, size_t light_idx) {
+  const light_t& light = s.lights[light_idx];
+  std::vector<sphere_t> bounds;
+  for (size_t i = 0u; i < s.geometry.spheres.size(); ++i) {
+    if (s.sphere_materials[i].opacity < 1.f) {
+      bounds.push_back(s.geometry.spheres[i]);
+    }
+  }
+  for (size_t i = 0u; i < s.geometry.meshes.size(); ++i) {
+    if (s.mesh_materials[i].opacity < 1.f) {
+      bounds.push_back(s.geometry.meshes[i].bounding_sphere);
+    }
+  }
+
+  projection_map map;
+  map.emits_everywhere = false;
+  float total_area = 0.f;
+  // the surfaces of the bounds around the light, which every photon leaves
+  float enclosing_area = 0.f;
+  for (const sphere_t& sphere : bounds) {
+    vec3f to_center = sphere.center - light.position;
+    float dist_sq = dot(to_center, to_center);
+    if (dist_sq <= sphere.radius_squared) {
+      map.emits_everywhere = true;
+      enclosing_area += 4.f * float(M_PI) * sphere.radius_squared;
+    } else {
+      float cos_max = std::sqrt(1.f - sphere.radius_squared / dist_sq);
+      float solid_angle = 2.f * float(M_PI) * (1.f - cos_max);
+      float area = float(M_PI) * sphere.radius_squared;
+      // the probability is normalized once every area is known
+      map.targets.push_back(emission_target{
+        normalized(to_center), cos_max, solid_angle, area });
+      total_area += area;
+    }
+  }
+  for (emission_target& target : map.targets) {
+    target.probability /= total_area;
+  }
+  if (map.emits_everywhere) {
+    map.targets.clear();
+  }
+
+  if (s.photon_density > 0.f) {
+    // shared like photon_samples, so a sphere light's points emit the
+    // count once between them
+    size_t total = size_t(std::ceil(s.photon_density *
+      (total_area + enclosing_area)));
+    map.photon_count = total / light.share_count +
+      (light.share_index < total % light.share_count ? 1u : 0u);
+  } else if (bounds.empty()) {
+    map.photon_count = 0u;
+  } else {
+    map.photon_count = light.photon_samples;
+  }
+  return map;
+}
+
+// a direction within the cone, chosen evenly by solid angle
+template<class T>
+vec3f direction_in_cone(const emission_target& target, T& rng) {
+  const vec3f& axis = target.axis;
+  vec3f helper = std::abs(axis.x()) > 0.9f ? vec3f(0,1,0) : vec3f(1,0,0);
+  vec3f tangent = normalized(cross(helper, axis));
+  vec3f bitangent = cross(axis, tangent);
+
+  float cos_theta = 1.f - rng() * (1.f - target.cos_max);
+  float sin_theta = std::sqrt(std::max(0.f, 1.f - cos_theta * cos_theta));
+  float phi = 2.f * float(M_PI) * rng();
+  return sin_theta * std::cos(phi) * tangent +
+    sin_theta * std::sin(phi) * bitangent + cos_theta * axis;
+}
+
+/* Picks the direction of a photon from the projection map, and returns
+   the factor its energy is scaled by. Directions the light doesn't emit
+   in have a factor of zero.
+*/
+template<class T>
+float emission_direction(const projection_map& map, T& rng,
+  vec3f& direction)
+{
+  if (map.emits_everywhere) {
+    direction = random_downward_direction(rng);
+    return 1.f;
+  }
+
+  float choice = rng();
+  size_t chosen = map.targets.size() - 1u;
+  for (size_t i = 0u; i < map.targets.size(); ++i) {
+    if (choice < map.targets[i].probability) {
+      chosen = i;
+      break;
+    }
+    choice -= map.targets[i].probability;
+  }
+  direction = direction_in_cone(map.targets[chosen], rng);
+  if (direction.y() > 0.f) {
+    return 0.f;
+  }
+
+  // the cones may overlap, so any of them could have produced it
+  float pdf = 0.f;
+  for (const emission_target& target : map.targets) {
+    if (dot(direction, target.axis) >= target.cos_max) {
+      pdf += target.probability / target.solid_angle;
+    }
+  }
+  return pdf > 0.f ? DOWNWARD_PDF / pdf : 0.f;
+}
+
+// photons are traced in batches of this size, each with its own generator
+const size_t PHOTON_BATCH_SIZE = 4096u;
+
+// gather points are refined in chunks of this size
+const size_t GATHER_CHUNK_SIZE = 256u;
+
+// the fraction of each pass's photons kept when a gather radius shrinks
+const float PPM_ALPHA = 0.7f;
+
+/* A photon found while the map is being created, and the object it hit,
+   numbered with spheres first, then meshes. Its position is only
+   quantized once the bounds of all the photons on the object are known.
+*/
+struct deposited_photon {
+  uint32_t object;
+  vec3f position;
+  photon_hit hit;
+};
+
+typedef std::vector<deposited_photon> photon_deposits;
+
+/* A run of consecutive photons from one light. Each photon is seeded by
+   its index, and the batches don't depend on the thread count, so neither
+   do the photons or the order they're merged.
+*/
+struct photon_batch {
+  unsigned pass;
+  size_t light_idx;
+  const projection_map* projection;
+  size_t first_photon;
+  size_t photon_count;
+  photon_deposits deposits;
+};
+
+/* Photons only land on objects linked to the light that emitted them,
+   and fade with distance from it like the light's direct contribution.
+*/
+vec3f deposited_energy(const scene_t& s, size_t light_idx,
+  const light_link_t& links, const vec3f& position, const vec3f& energy)
+{
+  if (!links.illuminated_by(light_idx)) {
+    return vec3f(0,0,0);
+  }
+  const light_t& light = s.lights[light_idx];
+  return light_falloff(light, magnitude(position - light.position)) * energy;
+}
+
+void map_photon(const ray_t& ray, const scene_t& s, size_t light_idx,
+  const vec3f& energy, float refractive_index, bool indirect,
+  unsigned int recursion_depth, photon_deposits& deposits) {
+  ray_sphere_intersect rsi = get_ray_sphere_intersect(ray, s.geometry.spheres);
+  ray_mesh_intersect rmi = get_ray_mesh_intersect(ray, s.geometry.meshes);
+
+  nearest_t nearest =
+    nearest_intersect(rsi, s.geometry.spheres, rmi, s.geometry.meshes);
+  if (nearest == SPHERE_NEAREST) {
+    size_t sphere_idx = rsi.index_in(s.geometry.spheres);
+    material_t material = s.sphere_materials[sphere_idx];
+    if(material.opacity < 1.f) {
+      vec3f inside_pos = ray.position_at(rsi.t + BACKOFF);
+      vec3f normal = rsi.near_geometry_it->normal_at(inside_pos);
+      bool entering = true;
+      if (dot(ray.direction, normal) > 0.f) {
+        normal = -normal;
+        entering = false;
+      }
+      float new_refractive_index = entering ? material.refractive_index : 1.f;
+      ray_t refracted_ray = { inside_pos, refracted(ray.direction, normal,
+        refractive_index, new_refractive_index) };
+      if (recursion_depth < MAX_RECURSE) {
+        map_photon(refracted_ray, s, light_idx, energy, new_refractive_index,
+          true, recursion_depth + 1u, deposits);
+      } else {
+        std::cerr << "Hit max recurse depth!" << std::endl;
+      }
+    // todo: handle reflective
+    } else if (indirect) {
+      vec3f position = ray.position_at(rsi.t);
+      vec3f deposit = deposited_energy(s, light_idx,
+        s.sphere_light_links[sphere_idx], position, energy);
+      if (deposit != vec3f(0,0,0)) {
+        deposits.push_back(deposited_photon{uint32_t(sphere_idx), position,
+          photon_hit::pack(ray.direction, deposit)});
+      }
+    }
+  } else if (nearest == MESH_NEAREST) {
+    size_t mesh_idx = rmi.index_in(s.geometry.meshes);
+    material_t material = s.mesh_materials[mesh_idx];
+    if (material.opacity < 1.f) {
+      vec3f inside_pos = ray.position_at(rmi.t + BACKOFF);
+      vec3f normal = rmi.get_normal_at(inside_pos);
+      if (dot(ray.direction, normal) > 0.f) {
+        normal = -normal;
+      }
+      // todo: handle refractive index for leaving a volume
+      ray_t refracted_ray = { inside_pos, refracted(ray.direction, normal,
+        refractive_index, material.refractive_index) };
+      if (recursion_depth < MAX_RECURSE) {
+        map_photon(refracted_ray, s, light_idx, energy,
+          material.refractive_index, true, recursion_depth + 1u, deposits);
+      } else {
+        std::cerr << "Hit max recurse depth!" << std::endl;
+      }
+    } else if (indirect) {
+      vec3f position = ray.position_at(rmi.t);
+      vec3f deposit = deposited_energy(s, light_idx,
+        s.mesh_light_links[mesh_idx], position, energy);
+      if (deposit != vec3f(0,0,0)) {
+        size_t object = s.geometry.spheres.size() + mesh_idx;
+        deposits.push_back(deposited_photon{uint32_t(object), position,
+          photon_hit::pack(ray.direction, deposit)});
+      }
+    }
+  }
+}
+
+void trace_photon_batch(const scene_t& s, photon_batch& batch) {
+  const light_t& light = s.lights[batch.light_idx];
+  unsigned stream = counter_seed(batch.pass, unsigned(batch.light_idx));
+  sampler rng(s.sampler);
+  const projection_map& projection = *batch.projection;
+  vec3f energy =
+    vec3f{1.f,1.f,1.f} * light.intensity / projection.photon_count;
+  for (size_t i = 0; i < batch.photon_count; ++i) {
+    ray_t ray = { light.position, vec3f(0,0,0) };
+    rng.start_sample(stream, unsigned(batch.first_photon + i),
+      unsigned(projection.photon_count));
+    float scale = emission_direction(projection, rng, ray.direction);
+    if (scale <= 0.f) {
+      continue;
+    }
+    float refractive_index = 1.f;
+    unsigned int recursion_depth = 0u;
+    bool indirect = false;
+    map_photon(ray, s, batch.light_idx, scale * energy, refractive_index,
+      indirect, recursion_depth, batch.deposits);
+  }
+}
+
+void trace_photon_batches(const scene_t& s,
+  std::vector<photon_batch>& batches, std::atomic<size_t>& next_batch)
+{
+  for (size_t i = next_batch++; i < batches.size(); i = next_batch++) {
+    trace_photon_batch(s, batches[i]);
+  }
+}
+
+std::vector<photon_batch> split_into_batches(
+  const std::vector<projection_map>& projections, unsigned pass)
+{
+  std::vector<photon_batch> batches;
+  for (size_t light_idx = 0u; light_idx < projections.size(); ++light_idx) {
+    const projection_map* projection = &projections[light_idx];
+    size_t samples = projection->photon_count;
+    for (size_t first = 0u; first < samples; first += PHOTON_BATCH_SIZE) {
+      size_t count = std::min(PHOTON_BATCH_SIZE, samples - first);
+      batches.push_back(
+        photon_batch{pass, light_idx, projection, first, count, {}});
+    }
+  }
+  return batches;
+}
+
+/* Merges the batches in order into one array, with each object's photons
+   in a run laid out as a kd-tree, so lookups only have to look at the
+   photons near the shaded point.
+*/
+photon_map build_photon_trees(const scene_t& s,
+  std::vector<photon_batch>& batches)
+{
+  size_t object_count = s.geometry.spheres.size() + s.geometry.meshes.size();
+  std::vector<size_t> counts(object_count);
+  std::vector<vec3f> lower(object_count, vec3f(FLT_MAX, FLT_MAX, FLT_MAX));
+  std::vector<vec3f> upper(object_count, vec3f(-FLT_MAX, -FLT_MAX, -FLT_MAX));
+  for (const photon_batch& batch : batches) {
+    for (const deposited_photon& p : batch.deposits) {
+      ++counts[p.object];
+      vec3f& low = lower[p.object];
+      vec3f& high = upper[p.object];
+      for (size_t axis = 0u; axis < 3u; ++axis) {
+        low[axis] = std::min(low[axis], p.position[axis]);
+        high[axis] = std::max(high[axis], p.position[axis]);
+      }
+    }
+  }
+  std::vector<photon_position> boxes;
+  for (size_t i = 0u; i < object_count; ++i) {
+    boxes.push_back(counts[i] == 0u ?
+      photon_position() : photon_position(lower[i], upper[i]));
+  }
+  std::vector<size_t> next(object_count);
+  size_t total = 0u;
+  for (size_t i = 0u; i < object_count; ++i) {
+    next[i] = total;
+    total += counts[i];
+  }
+
+  photon_map map;
+  map.photons.resize(total);
+  map.axes.resize(total);
+  for (auto& batch : batches) {
+    for (const deposited_photon& p : batch.deposits) {
+      photon_hit& photon = map.photons[next[p.object]++];
+      photon = p.hit;
+      photon.place(boxes[p.object], p.position);
+    }
+    photon_deposits().swap(batch.deposits);
+  }
+
+  size_t first = 0u;
+  for (size_t i = 0u; i < object_count; ++i) {
+    photon_tree::build(map.photons.data() + first, map.axes.data() + first,
+      counts[i], boxes[i]);
+    first += counts[i];
+  }
+  index_photon_map(s, counts, boxes, map);
+  return map;
+}
+
+/* Adds one pass of photons to a gather point (Hachisuka et al. 2008).
+   Of the M photons found, only alpha M are kept in the running count N,
+   and the radius shrinks so the density N / R^2 stays consistent with all
+   N + M photons having been found within it. The flux is scaled by the
+   change in area, dropping the share that fell outside the new radius.
+*/
+void refine_gather_point(gather_point& point, const photon_map& map) {
+  const photon_tree& photons = point.on_mesh ?
+    map.mesh_photons[point.obj_idx] : map.sphere_photons[point.obj_idx];
+  float found = 0.f;
+  vec3f found_flux(0,0,0);
+  photons.for_each_within(point.position, std::sqrt(point.radius_sq),
+    [&](const photon_hit& photon, float dist_sq) {
+      found += 1.f;
+      found_flux += photon.color() *
+        photon_kernel(point.on_mesh, dist_sq / point.radius_sq) *
+        std::max(dot(point.normal, -photon.direction()), 0.f);
+    });
+  if (found == 0.f) {
+    return;
+  }
+  float kept = point.photon_count + PPM_ALPHA * found;
+  float shrink = kept / (point.photon_count + found);
+  point.photon_count = kept;
+  point.radius_sq *= shrink;
+  point.flux = (point.flux + found_flux) * shrink;
+}
+
+void refine_gather_chunks(std::vector<gather_point>& points,
+  const photon_map& map, std::atomic<size_t>& next_chunk)
+{
+  for (size_t first = GATHER_CHUNK_SIZE * next_chunk++; first < points.size();
+    first = GATHER_CHUNK_SIZE * next_chunk++)
+  {
+    size_t last = std::min(first + GATHER_CHUNK_SIZE, points.size());
+    for (size_t i = first; i < last; ++i) {
+      refine_gather_point(points[i], map);
+    }
+  }
+}
+
+} // namespace
+
+photon_map trace_photons(const scene_t& s, unsigned pass,
+  thread_pool& pool)
+{
+  std::vector<projection_map> projections;
+  for (size_t light_idx = 0u; light_idx < s.lights.size(); ++light_idx) {
+    projections.push_back(create_projection_map(s, light_idx));
+  }
+  std::vector<photon_batch> batches = split_into_batches(projections, pass);
+  std::atomic<size_t> next_batch(0u);
+  pool.run([&](unsigned) {
+    trace_photon_batches(s, batches, next_batch);
+  });
+  return build_photon_trees(s, batches);
+}
+
+void create_photon_map(const scene_t& s, thread_pool& pool) {
+  if (s.integrator != PHOTON_INTEGRATOR) {
+    std::vector<photon_batch> no_batches;
+    g_photon_map = build_photon_trees(s, no_batches);
+    return;
+  }
+
+  std::cout << "Creating photon map..." << std::endl;
+  std::cout << "Lights: " << s.lights.size() << std::endl;
+  g_photon_map = trace_photons(s, 0u, pool);
+  std::cout << "Spheres: " << g_photon_map.sphere_photons.size() << std::endl;
+  for (auto&& tree : g_photon_map.sphere_photons) {
+    std::cout << "Hits: " << tree.size() << std::endl;
+  }
+  std::cout << "Meshes: " << g_photon_map.mesh_photons.size() << std::endl;
+  for (auto&& tree : g_photon_map.mesh_photons) {
+    std::cout << "Hits: " << tree.size() << std::endl;
+  }
+  std::cout << "Finished photon map." << std::endl;
+}
+
+unsigned trace_progressive_photons(const scene_t& s,
+  std::vector<gather_point>& points, thread_pool& pool,
+  const std::function<bool()>& stop)
+{
+  std::cout << "Gather points: " << points.size() << std::endl;
+  unsigned pass = 0u;
+  for (; pass < s.photon_passes; ++pass) {
+    if (pass > 0u && stop()) {
+      std::cout << "Stopped photon passes early" << std::endl;
+      break;
+    }
+    photon_map map = trace_photons(s, pass, pool);
+    std::atomic<size_t> next_chunk(0u);
+    pool.run([&](unsigned) {
+      refine_gather_chunks(points, map, next_chunk);
+    });
+    std::cout << "Photon pass " << pass + 1u << "/" << s.photon_passes
+      << std::endl;
+  }
+  return pass;
+}
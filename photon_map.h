@@ -0,0 +1,102 @@
+#ifndef PHOTON_MAP_H
+#define PHOTON_MAP_H
+
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <vector>
+#include "kd_tree.h"
+#include "photon_hit.h"
+#include "scene.h"
+#include "thread_pool.h"
+#include "vec3f.h"
+
+typedef kd_tree_view<photon_hit, photon_position> photon_tree;
+
+/* The weight of a gathered photon by its squared distance from the shaded
+   point, as a fraction of the gather radius squared. Spheres and meshes
+   have always weighted photons differently.
+*/
+inline float photon_kernel(bool on_mesh, float dist_sq) {
+  if (on_mesh) {
+    return std::sqrt(1.f - dist_sq);
+  } else {
+    return 1.f - dist_sq;
+  }
+}
+
+/* The photons that landed on each object. Every object's photons are laid
+   out as a kd-tree in one run of a single array, and the trees are indexed
+   like the scene geometry.
+*/
+struct photon_map {
+  photon_map() = default;
+  photon_map(photon_map&&) = default;
+  photon_map& operator=(photon_map&&) = default;
+  // the trees point into the arrays, so a copy would share them
+  photon_map(const photon_map&) = delete;
+  photon_map& operator=(const photon_map&) = delete;
+
+  std::vector<photon_hit> photons;
+  std::vector<uint8_t> axes;
+  std::vector<photon_tree> sphere_photons;
+  std::vector<photon_tree> mesh_photons;
+};
+
+/* Points the map's trees at consecutive runs of its photons and axes,
+   with counts giving the length of each run, and boxes the box its
+   positions are quantized in, spheres first.
+*/
+void index_photon_map(const scene_t& s, const std::vector<size_t>& counts,
+  const std::vector<photon_position>& boxes, photon_map& map);
+
+extern photon_map g_photon_map;
+
+/* Traces the photons of every light on the pool's threads. The map is
+   the same for a given scene whatever the number of threads.
+*/
+void create_photon_map(const scene_t& s, thread_pool& pool);
+
+/* Traces the given pass of photons from every light, on the pool's
+   threads. Each pass seeds its photons differently, so later passes find
+   new photons.
+*/
+photon_map trace_photons(const scene_t& s, unsigned pass, thread_pool& pool);
+
+/* A point seen from the camera where progressive photon mapping gathers
+   photons. Rather than the photons, it keeps statistics about them: each
+   pass adds the flux of the photons within its radius, then shrinks the
+   radius in proportion to how many it found.
+*/
+struct gather_point {
+  vec3f position;
+  vec3f normal;
+  vec3f weight; // how much of the light gathered here reaches the pixel
+  unsigned pixel; // y * width + x
+  bool on_mesh;
+  size_t obj_idx;
+  float radius_sq;
+  float photon_count;
+  vec3f flux;
+};
+
+/* Runs the scene's photon passes, refining every gather point. Only one
+   pass of photons is held in memory at a time. Before each pass after
+   the first, stop is asked whether to end early. Returns the number of
+   passes run.
+*/
+unsigned trace_progressive_photons(const scene_t& s,
+  std::vector<gather_point>& points, thread_pool& pool,
+  const std::function<bool()>& stop);
+
+/* The light at a gather point after the given number of passes, scaled to
+   match gathering a single pass within photon_radius.
+*/
+inline vec3f gathered_light(const gather_point& point, const scene_t& s,
+  unsigned passes)
+{
+  float initial_radius_sq = s.photon_radius * s.photon_radius;
+  return point.flux * (initial_radius_sq / (point.radius_sq * passes));
+}
+
+#endif
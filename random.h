@@ -0,0 +1,80 @@
+#ifndef RANDOM_H
+#define RANDOM_H
+
+#include <cstdint>
+
+/* The splitmix64 finalizer, which scatters nearby numbers far apart.
+*/
+inline uint64_t mix_bits(uint64_t x) {
+  x += 0x9e3779b97f4a7c15ull;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+  return x ^ (x >> 31);
+}
+
+/* A source of random floats, uniformly distributed over [0, 1).
+
+   This is PCG32: 16 bytes of state, seeded in a few instructions, with
+   2^63 independent streams, each of which can be jumped forwards in
+   logarithmic time. Work can be seeded by what it is, such as a pixel and
+   sample, at no cost, and any part of it reproduced on its own.
+*/
+class uniform_rng {
+public:
+  explicit uniform_rng(uint64_t seed = 0u, uint64_t stream = 0u) {
+    this->seed(seed, stream);
+  }
+
+  void seed(uint64_t seed, uint64_t stream = 0u) {
+    state_ = 0u;
+    increment_ = (stream << 1) | 1u;
+    next();
+    state_ += seed;
+    next();
+  }
+
+  // skips the next delta numbers
+  void advance(uint64_t delta) {
+    uint64_t multiplier = MULTIPLIER;
+    uint64_t increment = increment_;
+    uint64_t total_multiplier = 1u;
+    uint64_t total_increment = 0u;
+    // compose the step with itself, by squaring, for each bit of delta
+    for (; delta > 0u; delta >>= 1) {
+      if (delta & 1u) {
+        total_multiplier *= multiplier;
+        total_increment = total_increment * multiplier + increment;
+      }
+      increment *= multiplier + 1u;
+      multiplier *= multiplier;
+    }
+    state_ = total_multiplier * state_ + total_increment;
+  }
+
+  uint32_t next() {
+    uint64_t old = state_;
+    state_ = old * MULTIPLIER + increment_;
+    uint32_t shifted = uint32_t(((old >> 18) ^ old) >> 27);
+    uint32_t rotation = uint32_t(old >> 59);
+    return (shifted >> rotation) | (shifted << ((32u - rotation) & 31u));
+  }
+
+  float operator()() {
+    return float(next() >> 8) / 16777216.f;
+  }
+
+private:
+  static const uint64_t MULTIPLIER = 6364136223846793005ull;
+
+  uint64_t state_;
+  uint64_t increment_;
+};
+
+/* Mixes a stream and a counter into a seed, so work can be seeded by its
+   position rather than by the thread running it.
+*/
+inline unsigned counter_seed(unsigned stream, unsigned counter) {
+  return unsigned(mix_bits((uint64_t(stream) << 32) | counter));
+}
+
+#endif
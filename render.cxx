@@ -0,0 +1,685 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <string>
+#include "checkpoint.h"
+#include "render.h"
+#include "sampler.h"
+#include "scheduler.h"
+#include "trace.h"
+
+volatile std::sig_atomic_t g_snapshot_requested = 0;
+volatile std::sig_atomic_t g_stop_requested = 0;
+
+namespace {
+
+// images with fewer tiles than this split their samples into more tasks
+const size_t MIN_RENDER_TASKS = 64u;
+
+// passes double in samples until they're this large
+const unsigned MAX_PASS_SAMPLES = 16u;
+
+// previews trace secondary rays only this deep
+const unsigned PREVIEW_DEPTH = 2u;
+
+// previews are small, so smaller tiles keep the threads busy
+const unsigned PREVIEW_TILE_SIZE = 8u;
+
+/* A tile of the image and the share of its samples one task renders,
+   out of the samples of the pass it belongs to.
+*/
+struct render_task {
+  size_t tile_idx;
+  unsigned first_sample;
+  unsigned last_sample;
+  unsigned pass_samples;
+};
+
+/* What a render task produces: the totals of its samples for each pixel
+   of its tile, row by row, and its gather points. A task that was stopped
+   before taking all its samples isn't finished, and one never started has
+   no pixels.
+*/
+struct render_result {
+  render_result()
+    : finished(false)
+    , seconds(0.)
+  {
+  }
+
+  bool finished;
+  std::vector<vec3f> light;
+  std::vector<unsigned> sample_counts;
+  std::vector<float> brightness_sums;
+  std::vector<float> brightness_sums_sq;
+  std::vector<gather_point> gather_points;
+  // when profiling, the rays the task cast and the time it took
+  ray_profile rays;
+  double seconds;
+};
+
+/* Counts finished tasks, to report progress as they complete.
+*/
+struct render_progress {
+  render_progress(size_t task_count, bool display)
+    : task_count(task_count)
+    , finished(0u)
+    , display(display)
+  {
+  }
+
+  void finish_task() {
+    if (!display) {
+      return;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    ++finished;
+    unsigned current = unsigned(100u * finished / task_count);
+    unsigned previous = unsigned(100u * (finished - 1u) / task_count);
+    if (current != previous) {
+      std::cout << current << "%" << std::endl;
+    }
+  }
+
+  const size_t task_count;
+  size_t finished;
+  const bool display;
+  std::mutex mutex;
+};
+
+/* The variance of the mean of a pixel's samples, its squared standard
+   error, from the sum and sum of squares of their brightness. Brightness is
+   clamped as the image will be, so pixels far too bright don't look noisy.
+*/
+float pixel_error_sq(float sum, float sum_sq, unsigned count) {
+  if (count < 2u) {
+    return std::numeric_limits<float>::infinity();
+  }
+  float variance = std::max(sum_sq - sum * sum / count, 0.f) / (count - 1u);
+  return variance / count;
+}
+
+// whether a pixel's samples vary little enough to stop sampling it
+bool pixel_converged(float sum, float sum_sq, unsigned count,
+  float noise_threshold)
+{
+  return pixel_error_sq(sum, sum_sq, count) <=
+    noise_threshold * noise_threshold;
+}
+
+void render_tile(const scene_t& s,
+  const render_options& options,
+  const std::vector<tile_t>& tiles,
+  const render_task& task,
+  const accumulation_buffer* buffer,
+  bool records_gather_points,
+  render_result& result)
+{
+  const vec3f screen_offset_per_px_x = s.screen_offset_per_px_x();
+  const vec3f screen_offset_per_px_y = s.screen_offset_per_px_y();
+  const tile_t& tile = tiles[task.tile_idx];
+  trace_context ctx;
+  ctx.gather_points = records_gather_points ? &result.gather_points : 0;
+  ctx.rng = sampler(s.sampler);
+  ctx.profile = options.profiles_rays ? &result.rays : 0;
+  sampler& rng = ctx.rng;
+  size_t pixel_count = tile.width() * tile.height();
+  result.light.assign(pixel_count, vec3f(0,0,0));
+  result.sample_counts.assign(pixel_count, 0u);
+  result.brightness_sums.assign(pixel_count, 0.f);
+  result.brightness_sums_sq.assign(pixel_count, 0.f);
+
+  unsigned task_samples = task.last_sample - task.first_sample;
+  bool adaptive = s.noise_threshold > 0.f;
+
+  for (unsigned y = tile.y0; y < tile.y1; ++y) {
+    for (unsigned x = tile.x0; x < tile.x1; ++x) {
+      ctx.pixel = y * s.res.x + x;
+      // the samples of earlier passes, which later ones continue from
+      unsigned prior_count = buffer ? buffer->sample_counts[ctx.pixel] : 0u;
+      float prior_sum = buffer ? buffer->brightness_sums[ctx.pixel] : 0.f;
+      float prior_sum_sq = buffer ?
+        buffer->brightness_sums_sq[ctx.pixel] : 0.f;
+      // a task taking a share of a pass takes that share of the samples
+      // the pixel still needs before it may stop
+      unsigned needed = s.min_sample_count - std::min(prior_count,
+        s.min_sample_count);
+      unsigned min_samples = (needed * task_samples + task.pass_samples -
+        1u) / task.pass_samples;
+
+      vec3f px_color = { 0, 0, 0 };
+      float brightness_sum = 0.f;
+      float brightness_sum_sq = 0.f;
+      unsigned count = 0u;
+      bool stopped = false;
+      while (count < task_samples) {
+        if (should_stop(options)) {
+          stopped = true;
+          break;
+        }
+        if (adaptive && count >= min_samples &&
+          pixel_converged(prior_sum + brightness_sum,
+            prior_sum_sq + brightness_sum_sq, prior_count + count,
+            s.noise_threshold))
+        {
+          break;
+        }
+
+        rng.start_sample(ctx.pixel, task.first_sample + count,
+          s.sample_count);
+        vec3f background_color = { 0, 0, 0 };
+        vec3f pixel_pos = s.camera.screen_top_left +
+          (x + rng()) * screen_offset_per_px_x +
+          (y + rng()) * screen_offset_per_px_y;
+        ray_t eye_ray = { pixel_pos,
+          normalized(pixel_pos - s.camera.observer) };
+        vec3f color = cast_ray(eye_ray, s, background_color, ctx);
+        px_color += color;
+        ++count;
+
+        float brightness = (std::min(color[0], 1.f) +
+          std::min(color[1], 1.f) + std::min(color[2], 1.f)) / 3.f;
+        brightness_sum += brightness;
+        brightness_sum_sq += brightness * brightness;
+      }
+      size_t idx = (y - tile.y0) * tile.width() + (x - tile.x0);
+      result.light[idx] = px_color;
+      result.sample_counts[idx] = count;
+      result.brightness_sums[idx] = brightness_sum;
+      result.brightness_sums_sq[idx] = brightness_sum_sq;
+      if (stopped) {
+        return;
+      }
+    }
+  }
+  result.finished = true;
+}
+
+void render_tasks(unsigned thread_id,
+  const scene_t& s,
+  const render_options& options,
+  const std::vector<tile_t>& tiles,
+  const std::vector<render_task>& tasks,
+  const accumulation_buffer* buffer,
+  bool records_gather_points,
+  work_queues& queues,
+  render_progress& progress,
+  std::vector<render_result>& results,
+  size_t& samples_taken)
+{
+  size_t task_idx;
+  while (!should_stop(options) && queues.next(thread_id, task_idx)) {
+    render_result& result = results[task_idx];
+    std::chrono::steady_clock::time_point start;
+    if (options.profiles_rays) {
+      start = std::chrono::steady_clock::now();
+    }
+    render_tile(s, options, tiles, tasks[task_idx], buffer,
+      records_gather_points, result);
+    if (options.profiles_rays) {
+      std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+      result.seconds = elapsed.count();
+    }
+    for (unsigned count : result.sample_counts) {
+      samples_taken += count;
+    }
+    progress.finish_task();
+  }
+}
+
+/* The sample each pass renders up to. Passes start with a single sample,
+   so the whole image is refined evenly whenever the render stops, and
+   double from there up to MAX_PASS_SAMPLES at a time.
+*/
+std::vector<unsigned> pass_ends(const scene_t& s) {
+  std::vector<unsigned> ends;
+  unsigned end = 0u;
+  while (end < s.sample_count) {
+    unsigned pass_samples = std::max(std::min(end, MAX_PASS_SAMPLES), 1u);
+    end = std::min(end + pass_samples, s.sample_count);
+    ends.push_back(end);
+  }
+  return ends;
+}
+
+/* The number of tiles covering the whole image, which decides how the
+   samples of a pass are split up, even when only part of it is rendered.
+*/
+size_t image_tile_count(const scene_t& s, unsigned tile_size) {
+  size_t columns = (s.res.x + tile_size - 1u) / tile_size;
+  size_t rows = (s.res.y + tile_size - 1u) / tile_size;
+  return columns * rows;
+}
+
+/* Tiles covering the scene's crop. A small crop is cut into smaller tiles
+   to keep the threads busy; that doesn't change the pixels, which only
+   depend on how their samples are split.
+*/
+std::vector<tile_t> crop_tiles(const scene_t& s, unsigned tile_size) {
+  const crop_t& crop = s.crop;
+  std::vector<tile_t> tiles;
+  for (;;) {
+    tiles = hilbert_tiles(crop.width(), crop.height(), tile_size);
+    if (crop.covers(s.res) || tiles.size() >= MIN_RENDER_TASKS ||
+      tile_size <= 8u)
+    {
+      break;
+    }
+    tile_size /= 2u;
+  }
+  for (tile_t& tile : tiles) {
+    tile.x0 += crop.x0;
+    tile.x1 += crop.x0;
+    tile.y0 += crop.y0;
+    tile.y1 += crop.y0;
+  }
+  return tiles;
+}
+
+// the tasks each tile's samples in a pass are split between
+size_t sample_chunks(size_t image_tiles, unsigned pass_samples) {
+  size_t chunk_count = (MIN_RENDER_TASKS + image_tiles - 1u) / image_tiles;
+  return std::max<size_t>(std::min<size_t>(chunk_count, pass_samples), 1u);
+}
+
+std::vector<render_task> pass_tasks(const std::vector<tile_t>& tiles,
+  size_t image_tiles, unsigned first_sample, unsigned last_sample)
+{
+  unsigned pass_samples = last_sample - first_sample;
+  size_t chunk_count = sample_chunks(image_tiles, pass_samples);
+
+  std::vector<render_task> tasks;
+  for (size_t tile_idx = 0u; tile_idx < tiles.size(); ++tile_idx) {
+    for (size_t chunk = 0u; chunk < chunk_count; ++chunk) {
+      render_task task = { tile_idx,
+        first_sample + unsigned(pass_samples * chunk / chunk_count),
+        first_sample + unsigned(pass_samples * (chunk + 1u) / chunk_count),
+        pass_samples };
+      tasks.push_back(task);
+    }
+  }
+  return tasks;
+}
+
+/* Renders a pass's tasks into results, returning whether they all
+   finished. Each thread renders from its node's scene, and counts the
+   samples it takes in thread_samples.
+*/
+bool render_pass(const std::vector<const scene_t*>& node_scenes,
+  const render_options& options,
+  thread_pool& pool,
+  const std::vector<tile_t>& tiles,
+  const std::vector<render_task>& tasks,
+  render_progress& progress,
+  const accumulation_buffer* buffer,
+  bool records_gather_points,
+  std::vector<render_result>& results,
+  std::vector<size_t>& thread_samples)
+{
+  results.assign(tasks.size(), render_result());
+  work_queues queues(tasks.size(), pool.thread_nodes());
+  pool.run([&](unsigned thread_id) {
+    const scene_t& s = *node_scenes[pool.thread_nodes()[thread_id]];
+    render_tasks(thread_id, s, options, tiles, tasks, buffer,
+      records_gather_points, queues, progress, results,
+      thread_samples[thread_id]);
+  });
+
+  return std::all_of(results.begin(), results.end(),
+    [](const render_result& result) { return result.finished; });
+}
+
+// adds a pass's results to the buffer, in task order
+void add_results(const scene_t& s,
+  const std::vector<tile_t>& tiles,
+  const std::vector<render_task>& tasks,
+  const std::vector<render_result>& results,
+  accumulation_buffer& buffer,
+  std::vector<gather_point>* gather_points)
+{
+  for (size_t task_idx = 0u; task_idx < tasks.size(); ++task_idx) {
+    const tile_t& tile = tiles[tasks[task_idx].tile_idx];
+    const render_result& result = results[task_idx];
+    if (result.sample_counts.empty()) {
+      continue;
+    }
+    for (unsigned y = tile.y0; y < tile.y1; ++y) {
+      for (unsigned x = tile.x0; x < tile.x1; ++x) {
+        size_t idx = (y - tile.y0) * tile.width() + (x - tile.x0);
+        size_t pixel = y * s.res.x + x;
+        buffer.light[pixel] += result.light[idx];
+        buffer.sample_counts[pixel] += result.sample_counts[idx];
+        buffer.brightness_sums[pixel] += result.brightness_sums[idx];
+        buffer.brightness_sums_sq[pixel] += result.brightness_sums_sq[idx];
+      }
+    }
+    if (gather_points) {
+      gather_points->insert(gather_points->end(),
+        result.gather_points.begin(), result.gather_points.end());
+    }
+  }
+}
+
+/* A copy of the scene for each of the pool's nodes, made by a thread on
+   that node so it's allocated in the node's memory. A pool on one node
+   shares the original.
+*/
+std::vector<std::unique_ptr<scene_t>> replicate_scene(const scene_t& s,
+  thread_pool& pool)
+{
+  std::vector<std::unique_ptr<scene_t>> replicas(pool.node_count());
+  if (pool.node_count() < 2u) {
+    return replicas;
+  }
+  std::vector<bool> copied(pool.node_count(), false);
+  std::vector<bool> copies(pool.size(), false);
+  for (unsigned thread_id = 0u; thread_id < pool.size(); ++thread_id) {
+    unsigned node = pool.thread_nodes()[thread_id];
+    copies[thread_id] = !copied[node];
+    copied[node] = true;
+  }
+  pool.run([&](unsigned thread_id) {
+    if (copies[thread_id]) {
+      replicas[pool.thread_nodes()[thread_id]].reset(new scene_t(s));
+    }
+  });
+  return replicas;
+}
+
+// reports the samples per second taken overall, and by each node
+void report_throughput(const thread_pool& pool,
+  const std::vector<size_t>& thread_samples, float seconds)
+{
+  std::vector<size_t> node_samples(pool.node_count(), 0u);
+  std::vector<unsigned> node_threads(pool.node_count(), 0u);
+  size_t total = 0u;
+  for (unsigned thread_id = 0u; thread_id < pool.size(); ++thread_id) {
+    unsigned node = pool.thread_nodes()[thread_id];
+    node_samples[node] += thread_samples[thread_id];
+    ++node_threads[node];
+    total += thread_samples[thread_id];
+  }
+  seconds = std::max(seconds, 1e-6f);
+  std::cout << "Samples per second: " << total / seconds << std::endl;
+  if (pool.node_count() < 2u) {
+    return;
+  }
+  for (unsigned node = 0u; node < pool.node_count(); ++node) {
+    std::cout << "  node " << node << ", " << node_threads[node]
+      << " threads: " << node_samples[node] / seconds << std::endl;
+  }
+}
+
+/* One pixel from each cell of a grid over the crop with about the given
+   number of cells, as a tile each. Each is at a random place in its cell,
+   but the same one every time.
+*/
+std::vector<tile_t> stratified_pixels(const crop_t& crop, unsigned count) {
+  unsigned columns = unsigned(std::sqrt(float(count) * crop.width() /
+    crop.height()) + 0.5f);
+  columns = std::max(std::min(columns, crop.width()), 1u);
+  unsigned rows = unsigned(float(count) / columns + 0.5f);
+  rows = std::max(std::min(rows, crop.height()), 1u);
+
+  uniform_rng rng;
+  std::vector<tile_t> pixels;
+  for (unsigned row = 0u; row < rows; ++row) {
+    unsigned y0 = crop.y0 + row * crop.height() / rows;
+    unsigned y1 = crop.y0 + (row + 1u) * crop.height() / rows;
+    for (unsigned column = 0u; column < columns; ++column) {
+      unsigned x0 = crop.x0 + column * crop.width() / columns;
+      unsigned x1 = crop.x0 + (column + 1u) * crop.width() / columns;
+      unsigned x = x0 + rng.next() % (x1 - x0);
+      unsigned y = y0 + rng.next() % (y1 - y0);
+      pixels.push_back(tile_t{ x, y, x + 1u, y + 1u });
+    }
+  }
+  return pixels;
+}
+
+void checkpoint(const render_options& options, uint64_t key,
+  unsigned passes_done, const accumulation_buffer& buffer,
+  const std::vector<gather_point>* gather_points)
+{
+  if (!save_checkpoint(options.checkpoint_file, key, passes_done, buffer,
+    gather_points))
+  {
+    std::cerr << "Failed to save checkpoint to " << options.checkpoint_file
+      << std::endl;
+  }
+}
+
+} // namespace
+
+bool should_stop(const render_options& options) {
+  return g_stop_requested ||
+    std::chrono::steady_clock::now() >= options.deadline;
+}
+
+bool render_image(const scene_t& s, const render_options& options,
+  thread_pool& pool, accumulation_buffer& buffer,
+  std::vector<gather_point>* gather_points)
+{
+  typedef std::chrono::steady_clock clock;
+  const clock::time_point start = clock::now();
+  const std::vector<tile_t> tiles = crop_tiles(s, options.tile_size);
+  const size_t image_tiles = image_tile_count(s, options.tile_size);
+  const std::vector<unsigned> ends = pass_ends(s);
+  const uint64_t key = render_key(s, options.tile_size);
+
+  std::vector<std::vector<render_task>> passes;
+  size_t task_count = 0u;
+  unsigned first_sample = 0u;
+  for (unsigned end : ends) {
+    passes.push_back(pass_tasks(tiles, image_tiles, first_sample, end));
+    if (passes.size() > options.passes_done) {
+      task_count += passes.back().size();
+    }
+    first_sample = end;
+  }
+
+  std::vector<std::unique_ptr<scene_t>> replicas = replicate_scene(s, pool);
+  std::vector<const scene_t*> node_scenes;
+  for (const auto& replica : replicas) {
+    node_scenes.push_back(replica ? replica.get() : &s);
+  }
+  std::vector<size_t> thread_samples(pool.size(), 0u);
+
+  render_progress progress(task_count, options.display_progress);
+  clock::time_point last_snapshot = clock::now();
+  clock::time_point last_checkpoint = clock::now();
+  std::vector<render_result> results;
+  bool finished = true;
+  for (size_t pass = options.passes_done; pass < passes.size(); ++pass) {
+    finished = render_pass(node_scenes, options, pool, tiles, passes[pass],
+      progress, &buffer, gather_points != 0, results, thread_samples);
+    if (!finished) {
+      // checkpoints hold whole passes, so save before adding a partial one
+      if (options.checkpoint_file) {
+        checkpoint(options, key, unsigned(pass), buffer, gather_points);
+      }
+      add_results(s, tiles, passes[pass], results, buffer, gather_points);
+      break;
+    }
+    add_results(s, tiles, passes[pass], results, buffer, gather_points);
+
+    std::chrono::duration<float> since_checkpoint =
+      clock::now() - last_checkpoint;
+    if (options.checkpoint_file &&
+      since_checkpoint.count() >= options.checkpoint_interval)
+    {
+      last_checkpoint = clock::now();
+      checkpoint(options, key, unsigned(pass + 1u), buffer, gather_points);
+    }
+
+    if (options.target_noise > 0.f && pass + 1u < passes.size() &&
+      image_noise(buffer, s.crop) <= options.target_noise)
+    {
+      finished = false;
+      break;
+    }
+
+    if (!options.progressive || !options.snapshot_file ||
+      pass + 1u == passes.size())
+    {
+      continue;
+    }
+    std::chrono::duration<float> since_snapshot =
+      clock::now() - last_snapshot;
+    if (g_snapshot_requested ||
+      since_snapshot.count() >= options.snapshot_interval)
+    {
+      g_snapshot_requested = 0;
+      last_snapshot = clock::now();
+      if (!save_snapshot(buffer, s.crop, options.backdrop,
+        options.snapshot_file))
+      {
+        std::cerr << "Failed to save snapshot to " << options.snapshot_file
+          << std::endl;
+      }
+    }
+  }
+
+  std::chrono::duration<float> elapsed = clock::now() - start;
+  if (options.reports_throughput) {
+    report_throughput(pool, thread_samples, elapsed.count());
+  }
+  return finished;
+}
+
+render_sample sample_render(const scene_t& s, const render_options& options,
+  thread_pool& pool, unsigned pixel_count,
+  std::vector<gather_point>* gather_points)
+{
+  std::vector<tile_t> pixels = stratified_pixels(s.crop, pixel_count);
+  std::vector<render_task> tasks;
+  for (size_t pixel = 0u; pixel < pixels.size(); ++pixel) {
+    tasks.push_back(render_task{ pixel, 0u, s.sample_count, s.sample_count });
+  }
+  render_options profiled = options;
+  profiled.profiles_rays = true;
+  profiled.deadline = std::chrono::steady_clock::time_point::max();
+
+  std::vector<const scene_t*> node_scenes(pool.node_count(), &s);
+  std::vector<size_t> thread_samples(pool.size(), 0u);
+  render_progress progress(tasks.size(), false);
+  std::vector<render_result> results;
+  render_pass(node_scenes, profiled, pool, pixels, tasks, progress, 0,
+    gather_points != 0, results, thread_samples);
+
+  render_sample sample;
+  sample.pixel_count = pixels.size();
+  for (const render_result& result : results) {
+    for (unsigned count : result.sample_counts) {
+      sample.sample_count += count;
+    }
+    sample.rays.add(result.rays);
+    sample.seconds += result.seconds;
+    if (gather_points) {
+      gather_points->insert(gather_points->end(),
+        result.gather_points.begin(), result.gather_points.end());
+    }
+  }
+  // the times include the time taken to time each ray
+  double overhead = ray_timing_overhead();
+  for (unsigned kind = 0u; kind < RAY_KIND_COUNT; ++kind) {
+    double timing = sample.rays.counts[kind] * overhead;
+    sample.rays.seconds[kind] = std::max(sample.rays.seconds[kind] - timing,
+      0.);
+    sample.seconds = std::max(sample.seconds - timing, 0.);
+  }
+  return sample;
+}
+
+size_t render_buffer_bytes(const scene_t& s, const render_options& options) {
+  const size_t pixel_bytes = sizeof(vec3f) + sizeof(unsigned) +
+    2u * sizeof(float);
+  size_t image_pixels = size_t(s.res.x) * s.res.y;
+  size_t crop_pixels = size_t(s.crop.width()) * s.crop.height();
+  unsigned largest_pass = 0u;
+  unsigned first_sample = 0u;
+  for (unsigned end : pass_ends(s)) {
+    largest_pass = std::max(largest_pass, end - first_sample);
+    first_sample = end;
+  }
+  size_t chunk_count = sample_chunks(image_tile_count(s, options.tile_size),
+    largest_pass);
+  // the buffer, a pass's results, and the image averaged from the buffer,
+  // its crop, and its bytes
+  return image_pixels * pixel_bytes + crop_pixels * chunk_count *
+    pixel_bytes + image_pixels * sizeof(vec3f) + crop_pixels *
+    (sizeof(vec3f) + 3u);
+}
+
+image render_preview(const scene_t& s, unsigned width, thread_pool& pool) {
+  scene_t preview = s;
+  preview.res.x = std::min(width, s.res.x);
+  preview.res.y = std::max(1u,
+    unsigned(float(s.res.y) * preview.res.x / s.res.x + 0.5f));
+  preview.crop = { 0u, 0u, preview.res.x, preview.res.y };
+  preview.sample_count = 1u;
+  preview.min_sample_count = 1u;
+  preview.noise_threshold = 0.f;
+  preview.integrator = WHITTED_INTEGRATOR;
+  preview.irradiance_error = 0.f;
+  preview.max_depth = PREVIEW_DEPTH;
+  // the preview gathers no photons, but tracing needs a tree per object;
+  // the render's map is put back after
+  photon_map render_map = std::move(g_photon_map);
+  create_photon_map(preview, pool);
+
+  render_options options;
+  options.tile_size = PREVIEW_TILE_SIZE;
+  options.reports_throughput = false;
+  accumulation_buffer buffer(preview.res.x, preview.res.y);
+  render_image(preview, options, pool, buffer, 0);
+  g_photon_map = std::move(render_map);
+  image img = buffer.average();
+  img.clamp_colors();
+  return img;
+}
+
+image output_image(const image& img, const crop_t& crop,
+  const image* backdrop)
+{
+  if (!backdrop && crop.covers({ img.width(), img.height() })) {
+    return img;
+  }
+  image part = img.region(crop.x0, crop.y0, crop.x1, crop.y1);
+  if (!backdrop) {
+    return part;
+  }
+  image composite = *backdrop;
+  composite.paste(part, crop.x0, crop.y0);
+  return composite;
+}
+
+bool save_snapshot(const accumulation_buffer& buffer, const crop_t& crop,
+  const image* backdrop, const char* path)
+{
+  image img = buffer.average();
+  img.clamp_colors();
+  std::string temp_path = std::string(path) + ".tmp";
+  if (!output_image(img, crop, backdrop).save_as_png(temp_path.c_str())) {
+    return false;
+  }
+  return std::rename(temp_path.c_str(), path) == 0;
+}
+
+float image_noise(const accumulation_buffer& buffer, const crop_t& crop) {
+  double total = 0.0;
+  for (unsigned y = crop.y0; y < crop.y1; ++y) {
+    for (unsigned x = crop.x0; x < crop.x1; ++x) {
+      size_t i = size_t(y) * buffer.width() + x;
+      total += pixel_error_sq(buffer.brightness_sums[i],
+        buffer.brightness_sums_sq[i], buffer.sample_counts[i]);
+    }
+  }
+  return float(std::sqrt(total / (double(crop.width()) * crop.height())));
+}
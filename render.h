@@ -0,0 +1,137 @@
+#ifndef RENDER_H
+#define RENDER_H
+
+#include <chrono>
+#include <csignal>
+#include <vector>
+#include "image.h"
+#include "photon_map.h"
+#include "scene.h"
+#include "thread_pool.h"
+#include "trace.h"
+
+// set, typically from a signal handler, to snapshot after the current pass
+extern volatile std::sig_atomic_t g_snapshot_requested;
+
+// set, typically from a signal handler, to stop rendering as soon as it can
+extern volatile std::sig_atomic_t g_stop_requested;
+
+struct render_options {
+  render_options()
+    : tile_size(32u)
+    , display_progress(false)
+    , progressive(false)
+    , snapshot_interval(60.f)
+    , snapshot_file(0)
+    , checkpoint_interval(300.f)
+    , checkpoint_file(0)
+    , passes_done(0u)
+    , deadline(std::chrono::steady_clock::time_point::max())
+    , target_noise(0.f)
+    , backdrop(0)
+    , profiles_rays(false)
+    , reports_throughput(true)
+  {
+  }
+
+  unsigned tile_size;
+  bool display_progress;
+  bool progressive; // save snapshots between passes
+  float snapshot_interval; // seconds between snapshots, if progressive
+  const char* snapshot_file; // if set, where snapshots are saved
+  float checkpoint_interval; // seconds between checkpoints
+  const char* checkpoint_file; // if set, where checkpoints are saved
+  unsigned passes_done; // passes already in the buffer, when resuming
+  std::chrono::steady_clock::time_point deadline; // when to stop, if ever
+  // if positive, stop once the image's noise falls to this
+  float target_noise;
+  const image* backdrop; // if set, snapshots of a crop are pasted onto it
+  bool profiles_rays; // count and time the rays each task casts
+  bool reports_throughput; // print the samples per second at the end
+};
+
+/* Whether a render with the options should stop now: it is past the
+   deadline, or g_stop_requested is set.
+*/
+bool should_stop(const render_options& options);
+
+/* Renders the scene, adding its samples to the buffer. For progressive
+   photon mapping, the points that will gather photons are appended to
+   gather_points. A render resumed from a checkpoint skips the passes
+   already done, and finishes exactly as it would have uninterrupted.
+
+   Rendering stops early at the deadline, or when g_stop_requested is set,
+   keeping the samples taken so far and checkpointing the passes finished,
+   or after the pass that brings the image's noise down to the target.
+   Returns whether every sample was taken.
+
+   The image is split into tiles, and when there are too few tiles to keep
+   the threads busy, each tile's samples are split between several tasks.
+   The split depends only on the image, so the results are summed in the
+   same order whatever the number of threads. Only the scene's crop is
+   rendered, split up so its pixels match a full render exactly. When the
+   pool's threads span several NUMA nodes, each node renders from its own
+   copy of the scene.
+   The samples each node took per second are reported at the end, if the
+   options say to.
+*/
+bool render_image(const scene_t& s, const render_options& options,
+  thread_pool& pool, accumulation_buffer& buffer,
+  std::vector<gather_point>* gather_points);
+
+/* What rendering a sample of a scene's pixels took.
+*/
+struct render_sample {
+  render_sample()
+    : pixel_count(0u)
+    , sample_count(0u)
+    , seconds(0.)
+  {
+  }
+
+  size_t pixel_count;
+  size_t sample_count; // taken by all the pixels
+  double seconds; // the time the threads spent rendering, added up
+  ray_profile rays; // the rays cast, less the time taken to time them
+};
+
+/* Renders about pixel_count pixels of the crop as render_image would, one
+   from each cell of an even grid over it, to estimate what rendering the
+   whole crop will take. The points that will gather photons are appended
+   to gather_points, if set.
+*/
+render_sample sample_render(const scene_t& s, const render_options& options,
+  thread_pool& pool, unsigned pixel_count,
+  std::vector<gather_point>* gather_points);
+
+/* The memory render_image allocates to render the scene, besides the
+   scene itself and any gather points.
+*/
+size_t render_buffer_bytes(const scene_t& s, const render_options& options);
+
+/* A rough look at the scene, quick enough to show before the render: the
+   whole image scaled down to the given width, one sample per pixel, with
+   direct light and shallow reflections and refractions only. The photon
+   map is left as it was.
+*/
+image render_preview(const scene_t& s, unsigned width, thread_pool& pool);
+
+/* What a render of the crop outputs from the full-size image: the crop,
+   pasted onto the backdrop if there is one.
+*/
+image output_image(const image& img, const crop_t& crop,
+  const image* backdrop);
+
+/* Saves the average of the buffer's samples so far as output_image would,
+   replacing the file only once the new one is complete.
+*/
+bool save_snapshot(const accumulation_buffer& buffer, const crop_t& crop,
+  const image* backdrop, const char* path);
+
+/* The root mean square of the standard error in brightness of the pixels
+   in the crop, on the same scale as a scene's noise_threshold. Infinite
+   until every pixel has two samples.
+*/
+float image_noise(const accumulation_buffer& buffer, const crop_t& crop);
+
+#endif
@@ -0,0 +1,216 @@
+#include <algorithm>
+#include "sampler.h"
+
+namespace {
+
+const unsigned PRIMES[] = {
+  2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37, 41, 43, 47, 53 };
+const unsigned HALTON_DIMENSIONS = sizeof(PRIMES) / sizeof(PRIMES[0]);
+
+// the Sobol dimensions scrambled together; later ones reuse them
+const unsigned SOBOL_DIMENSIONS = 4u;
+
+float to_unit_float(uint32_t x) {
+  return float(x >> 8) / 16777216.f;
+}
+
+uint32_t reverse_bits(uint32_t x) {
+  x = ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+  x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+  x = ((x >> 4) & 0x0f0f0f0fu) | ((x & 0x0f0f0f0fu) << 4);
+  x = ((x >> 8) & 0x00ff00ffu) | ((x & 0x00ff00ffu) << 8);
+  return (x >> 16) | (x << 16);
+}
+
+/* A random permutation of 32-bit numbers in which each bit only depends
+   on the bits below it (Laine and Karras). Applied to bit-reversed
+   numbers, it's an Owen scramble: each bit flips depending on the bits
+   above it, which keeps points stratified while randomizing them.
+*/
+uint32_t nested_uniform_scramble(uint32_t x, uint32_t seed) {
+  x = reverse_bits(x);
+  x += seed;
+  x ^= x * 0x6c50b47cu;
+  x ^= x * 0xb82f1e52u;
+  x ^= x * 0xc7afe638u;
+  x ^= x * 0x8d22f6e6u;
+  return reverse_bits(x);
+}
+
+struct sobol_directions {
+  sobol_directions() {
+    // Joe and Kuo's primitive polynomials, degree s with coefficients a,
+    // and initial direction numbers m, for the dimensions after the first
+    const unsigned s[] = { 1, 2, 3 };
+    const unsigned a[] = { 0, 1, 1 };
+    const unsigned m[][3] = { { 1, 0, 0 }, { 1, 3, 0 }, { 1, 3, 1 } };
+
+    for (unsigned bit = 0u; bit < 32u; ++bit) {
+      v[0][bit] = 1u << (31u - bit);
+    }
+    for (unsigned d = 1u; d < SOBOL_DIMENSIONS; ++d) {
+      unsigned degree = s[d - 1u];
+      for (unsigned bit = 0u; bit < 32u; ++bit) {
+        if (bit < degree) {
+          v[d][bit] = m[d - 1u][bit] << (31u - bit);
+        } else {
+          v[d][bit] = v[d][bit - degree] ^ (v[d][bit - degree] >> degree);
+          for (unsigned k = 1u; k < degree; ++k) {
+            if ((a[d - 1u] >> (degree - 1u - k)) & 1u) {
+              v[d][bit] ^= v[d][bit - k];
+            }
+          }
+        }
+      }
+    }
+  }
+
+  uint32_t v[SOBOL_DIMENSIONS][32];
+};
+
+} // namespace
+
+bool sampler_from_name(const std::string& name, sampler_t& type) {
+  if (name == "random") {
+    type = RANDOM_SAMPLER;
+  } else if (name == "stratified") {
+    type = STRATIFIED_SAMPLER;
+  } else if (name == "halton") {
+    type = HALTON_SAMPLER;
+  } else if (name == "sobol") {
+    type = SOBOL_SAMPLER;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+namespace sampling {
+
+// Kensler's hashed permutation, from "Correlated Multi-Jittered Sampling"
+unsigned permute(unsigned i, unsigned count, unsigned seed) {
+  unsigned w = count - 1u;
+  w |= w >> 1;
+  w |= w >> 2;
+  w |= w >> 4;
+  w |= w >> 8;
+  w |= w >> 16;
+  // hash within the next power of two until landing inside the range
+  do {
+    i ^= seed;
+    i *= 0xe170893du;
+    i ^= seed >> 16;
+    i ^= (i & w) >> 4;
+    i ^= seed >> 8;
+    i *= 0x0929eb3fu;
+    i ^= seed >> 23;
+    i ^= (i & w) >> 1;
+    i *= 1u | seed >> 27;
+    i *= 0x6935fa69u;
+    i ^= (i & w) >> 11;
+    i *= 0x74dcb303u;
+    i ^= (i & w) >> 2;
+    i *= 0x9e501cc3u;
+    i ^= (i & w) >> 2;
+    i *= 0xc860a3dfu;
+    i &= w;
+    i ^= i >> 5;
+  } while (i >= count);
+  return (i + seed) % count;
+}
+
+uint32_t sobol(uint32_t i, unsigned dimension) {
+  static const sobol_directions directions;
+  uint32_t x = 0u;
+  for (unsigned bit = 0u; i; ++bit, i >>= 1) {
+    if (i & 1u) {
+      x ^= directions.v[dimension][bit];
+    }
+  }
+  return x;
+}
+
+float radical_inverse(unsigned base, unsigned i) {
+  double inverse_base = 1.0 / base;
+  double scale = inverse_base;
+  double value = 0.0;
+  for (; i; i /= base, scale *= inverse_base) {
+    value += (i % base) * scale;
+  }
+  return float(std::min(value, 1.0 - 1e-7));
+}
+
+} // namespace sampling
+
+sampler::sampler()
+  : type_(RANDOM_SAMPLER)
+  , pattern_(0u)
+  , index_(0u)
+  , count_(1u)
+  , dimension_(0u)
+  , started_(false)
+{
+}
+
+sampler::sampler(sampler_t type)
+  : type_(type)
+  , pattern_(0u)
+  , index_(0u)
+  , count_(1u)
+  , dimension_(0u)
+  , started_(false)
+{
+}
+
+void sampler::seed(unsigned seed) {
+  rng_.seed(seed);
+}
+
+void sampler::start_sample(unsigned pattern, unsigned index, unsigned count) {
+  pattern_ = pattern;
+  index_ = index;
+  count_ = std::max(count, 1u);
+  dimension_ = 0u;
+  started_ = true;
+  rng_.seed(mix_bits((uint64_t(pattern) << 32) | index), pattern);
+}
+
+float sampler::operator()() {
+  if (!started_ || type_ == RANDOM_SAMPLER) {
+    return rng_();
+  }
+  unsigned dimension = dimension_++;
+  unsigned dimension_seed = counter_seed(pattern_, dimension);
+
+  switch (type_) {
+  case STRATIFIED_SAMPLER: {
+    // a shuffled stratum of the dimension, and a random point in it
+    unsigned stratum = sampling::permute(index_ % count_, count_,
+      dimension_seed);
+    float jitter = to_unit_float(counter_seed(dimension_seed, index_));
+    return std::min((stratum + jitter) / count_, 1.f - 1e-7f);
+  }
+  case HALTON_SAMPLER: {
+    if (dimension >= HALTON_DIMENSIONS) {
+      return rng_();
+    }
+    // shifted randomly per pattern, wrapping around
+    float value = sampling::radical_inverse(PRIMES[dimension], index_) +
+      to_unit_float(dimension_seed);
+    value -= value >= 1.f ? 1.f : 0.f;
+    return std::min(value, 1.f - 1e-7f);
+  }
+  case SOBOL_SAMPLER: {
+    // each group of dimensions is scrambled, and its points shuffled,
+    // with its own seed
+    unsigned group_seed = counter_seed(pattern_,
+      0x80000000u | (dimension / SOBOL_DIMENSIONS));
+    uint32_t index = nested_uniform_scramble(index_, group_seed);
+    uint32_t x = sampling::sobol(index, dimension % SOBOL_DIMENSIONS);
+    return to_unit_float(nested_uniform_scramble(x,
+      counter_seed(group_seed, dimension % SOBOL_DIMENSIONS)));
+  }
+  default:
+    return rng_();
+  }
+}
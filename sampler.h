@@ -0,0 +1,68 @@
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include <cstdint>
+#include <string>
+#include "random.h"
+
+enum sampler_t {
+  RANDOM_SAMPLER,
+  STRATIFIED_SAMPLER, // each dimension split evenly between the samples
+  HALTON_SAMPLER,
+  SOBOL_SAMPLER, // Owen-scrambled, in groups of four dimensions
+};
+
+/* Sets type to the sampler with the given name, returning false if there
+   is none.
+*/
+bool sampler_from_name(const std::string& name, sampler_t& type);
+
+/* sampler - the random numbers for a set of samples
+
+   Each call returns the next dimension of the current sample, so code
+   that takes a random number generator can take a sampler instead. With
+   start_sample, the samples of a pattern (a pixel, or a light's photons)
+   are spread evenly over each dimension, rather than independently, so
+   their average converges faster. Dimensions beyond what the sampler
+   covers, and all of them for the random sampler, come from an ordinary
+   random number generator, seeded by the pattern and index, so each sample
+   is the same however the work was divided up.
+*/
+class sampler {
+public:
+  sampler();
+  explicit sampler(sampler_t type);
+
+  // seeds the random numbers used before any sample is started
+  void seed(unsigned seed);
+
+  /* Starts sample index of count samples in the pattern. Different
+     patterns are scrambled differently, so they don't line up.
+  */
+  void start_sample(unsigned pattern, unsigned index, unsigned count);
+
+  float operator()();
+
+private:
+  sampler_t type_;
+  unsigned pattern_;
+  unsigned index_;
+  unsigned count_;
+  unsigned dimension_;
+  bool started_;
+  uniform_rng rng_;
+};
+
+namespace sampling {
+
+// the ith element of a pseudorandom permutation of [0, count)
+unsigned permute(unsigned i, unsigned count, unsigned seed);
+
+// the first 32 bits of dimension, up to 3, of the ith Sobol point
+uint32_t sobol(uint32_t i, unsigned dimension);
+
+float radical_inverse(unsigned base, unsigned i);
+
+} // namespace sampling
+
+#endif
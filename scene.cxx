@@ -1,7 +1,9 @@
 #include <functional>
 #include <iostream>
+#include <limits>
 #include <md2.h>
 #include <yaml-cpp/yaml.h>
+#include "random.h"
 #include "scene.h"
 
 using std::placeholders::_1;
@@ -35,6 +37,78 @@ resolution_t parse_resolution_node(const YAML::Node& node) {
   return value;
 }
 
+crop_t parse_crop_node(const YAML::Node& node) {
+  crop_t value;
+  if (node.size() == 4u) {
+    value.x0 = node[0].as<unsigned>();
+    value.y0 = node[1].as<unsigned>();
+    value.x1 = node[2].as<unsigned>();
+    value.y1 = node[3].as<unsigned>();
+  } else {
+    std::cerr << node.Tag() << " is a crop which requires 4 values, not "
+      << node.size() << "." << std::endl;
+    throw std::runtime_error("Incorrect number of nodes on crop");
+  }
+  return value;
+}
+
+/* An observer and screen, as in a camera or at the top of the scene. */
+camera_t parse_camera_node(const YAML::Node& node) {
+  camera_t camera;
+  if (YAML::Node observer = node["observer"]) {
+    camera.observer = parse_vec3f_node(observer);
+  } else {
+    throw std::runtime_error("Camera requires observer!");
+  }
+
+  if (YAML::Node screen = node["screen"]) {
+    if (YAML::Node top_left = screen["top_left"]) {
+      camera.screen_top_left = parse_vec3f_node(top_left);
+    } else {
+      throw std::runtime_error("Screen requires top left!");
+    }
+
+    if (YAML::Node top_right = screen["top_right"]) {
+      camera.screen_top_right = parse_vec3f_node(top_right);
+    } else {
+      throw std::runtime_error("Screen requires top right!");
+    }
+
+    if (YAML::Node bottom_right = screen["bottom_right"]) {
+      camera.screen_bottom_right = parse_vec3f_node(bottom_right);
+    } else {
+      throw std::runtime_error("Screen requires bottom right!");
+    }
+  } else {
+    throw std::runtime_error("Camera requires screen!");
+  }
+  return camera;
+}
+
+integrator_t parse_integrator_node(const YAML::Node& node) {
+  std::string name = node.as<std::string>();
+  if (name == "whitted") {
+    return WHITTED_INTEGRATOR;
+  } else if (name == "photon") {
+    return PHOTON_INTEGRATOR;
+  } else if (name == "path") {
+    return PATH_INTEGRATOR;
+  } else if (name == "ppm") {
+    return PROGRESSIVE_PHOTON_INTEGRATOR;
+  } else {
+    throw std::runtime_error("Unknown integrator \"" + name + "\"!");
+  }
+}
+
+sampler_t parse_sampler_node(const YAML::Node& node) {
+  std::string name = node.as<std::string>();
+  sampler_t type;
+  if (!sampler_from_name(name, type)) {
+    throw std::runtime_error("Unknown sampler \"" + name + "\"!");
+  }
+  return type;
+}
+
 sphere_t parse_sphere_node(const YAML::Node& node) {
   sphere_t value;
   if (YAML::Node center = node["center"]) {
@@ -175,6 +249,91 @@ material_t retrieve_optional_material(const YAML::Node& node) {
   return value;
 }
 
+/* The names of the lights an object is linked to, as written in the scene.
+   They can only be resolved to light indexes once all lights are loaded.
+*/
+struct light_link_names {
+  std::vector<std::string> include;
+  std::vector<std::string> exclude;
+};
+
+std::vector<std::string> parse_string_list_node(const YAML::Node& node) {
+  std::vector<std::string> value;
+  if (node.IsScalar()) {
+    value.push_back(node.as<std::string>());
+  } else {
+    for (auto it = node.begin(); it != node.end(); ++it) {
+      value.push_back(it->as<std::string>());
+    }
+  }
+  return value;
+}
+
+light_link_names retrieve_optional_light_links(const YAML::Node& node) {
+  light_link_names value;
+  if (YAML::Node n = node["lights"]) {
+    value.include = parse_string_list_node(n);
+  }
+  if (YAML::Node n = node["exclude_lights"]) {
+    value.exclude = parse_string_list_node(n);
+  }
+  return value;
+}
+
+void set_light_link(const std::string& name, bool enabled,
+  const std::vector<light_t>& lights, std::vector<bool>& mask)
+{
+  bool found = false;
+  for (size_t i = 0u; i < lights.size(); ++i) {
+    if (lights[i].name == name) {
+      mask[i] = enabled;
+      found = true;
+    }
+  }
+  if (!found) {
+    throw std::runtime_error("Unknown light \"" + name + "\" in light link!");
+  }
+}
+
+light_link_t resolve_light_links(const light_link_names& names,
+  const std::vector<light_t>& lights)
+{
+  light_link_t value;
+  if (names.include.empty() && names.exclude.empty()) {
+    return value;
+  }
+
+  value.mask.assign(lights.size(), names.include.empty());
+  for (const std::string& name : names.include) {
+    set_light_link(name, true, lights, value.mask);
+  }
+  for (const std::string& name : names.exclude) {
+    set_light_link(name, false, lights, value.mask);
+  }
+  return value;
+}
+
+float retrieve_optional_influence_radius(const YAML::Node& node) {
+  float value;
+  if (YAML::Node n = node["influence_radius"]) {
+    value = n.as<float>();
+    if (value <= 0.f) {
+      throw std::runtime_error("Light influence_radius must be positive!");
+    }
+  } else {
+    value = 0.f;
+  }
+  return value;
+}
+
+std::string retrieve_optional_name(const YAML::Node& node) {
+  std::string value;
+  if (YAML::Node n = node["name"]) {
+    value = n.as<std::string>();
+  }
+  return value;
+}
+
 light_t parse_point_light_node(const YAML::Node& node) {
   light_t value;
   if (YAML::Node position = node["position"]) {
@@ -201,6 +360,11 @@ light_t parse_point_light_node(const YAML::Node& node) {
     value.photon_samples = 10000000u;
   }
 
+  value.share_index = 0u;
+  value.share_count = 1u;
+  value.influence_radius = retrieve_optional_influence_radius(node);
+  value.name = retrieve_optional_name(node);
+
   return value;
 }
 
@@ -247,9 +411,24 @@ std::vector<light_t> parse_sphere_light_node(const YAML::Node& node) {
     seed = 0u;
   }
 
-  std::mt19937 engine(seed);
-  std::uniform_real_distribution<float> distribution(0.f, 1.f);
-  auto rng = std::bind(distribution, engine);
+  unsigned intensity;
+  if (YAML::Node n = node["intensity"]) {
+    intensity = n.as<unsigned>();
+  } else {
+    intensity = 30000u;
+  }
+
+  unsigned photon_samples;
+  if (YAML::Node n = node["photon_samples"]) {
+    photon_samples = n.as<unsigned>();
+  } else {
+    photon_samples = 10000000u;
+  }
+
+  float influence_radius = retrieve_optional_influence_radius(node);
+  std::string name = retrieve_optional_name(node);
+
+  uniform_rng rng(seed);
 
   float volume = 4.f / 3.f * M_PI * radius * radius * radius;
   size_t points_required = volume * density;
@@ -260,6 +439,15 @@ std::vector<light_t> parse_sphere_light_node(const YAML::Node& node) {
       light_t pl;
       pl.position = 2.f * radius * candidate + center;
       pl.color = per_point_color;
+      // the photons and their energy are shared between the points, the
+      // first points taking one more photon each until all are emitted
+      pl.intensity = float(intensity) / points_required;
+      pl.photon_samples = photon_samples / points_required +
+        (value.size() < photon_samples % points_required ? 1u : 0u);
+      pl.share_index = value.size();
+      pl.share_count = points_required;
+      pl.influence_radius = influence_radius;
+      pl.name = name;
       value.push_back(pl);
     }
   }
@@ -371,33 +559,35 @@ mesh_t parse_mesh_node(const YAML::Node& node) {
 scene_t load_scene_from_file(const char* scene_file) {
   scene_t s;
   YAML::Node config = YAML::LoadFile(scene_file);
-  if (YAML::Node observer = config["observer"]) {
-    s.observer = parse_vec3f_node(observer);
-  } else {
-    throw std::runtime_error("Scene requires observer!");
-  }
-
-  if (YAML::Node screen = config["screen"]) {
-    if (YAML::Node top_left = screen["top_left"]) {
-      s.screen_top_left = parse_vec3f_node(top_left);
-    } else {
-      throw std::runtime_error("Screen requires top left!");
+  if (YAML::Node cameras = config["cameras"]) {
+    if (config["observer"] || config["screen"]) {
+      throw std::runtime_error(
+        "Scene requires either observer and screen, or cameras!");
     }
-
-    if (YAML::Node top_right = screen["top_right"]) {
-      s.screen_top_right = parse_vec3f_node(top_right);
-    } else {
-      throw std::runtime_error("Screen requires top right!");
+    for (const YAML::Node& node : cameras) {
+      camera_t camera = parse_camera_node(node);
+      if (YAML::Node name = node["name"]) {
+        camera.name = name.as<std::string>();
+      }
+      if (camera.name.empty()) {
+        throw std::runtime_error("Camera requires name!");
+      }
+      for (const camera_t& other : s.cameras) {
+        if (other.name == camera.name) {
+          std::cerr << "There are several cameras named " << camera.name
+            << "." << std::endl;
+          throw std::runtime_error("Camera names must be unique!");
+        }
+      }
+      s.cameras.push_back(camera);
     }
-
-    if (YAML::Node bottom_right = screen["bottom_right"]) {
-      s.screen_bottom_right = parse_vec3f_node(bottom_right);
-    } else {
-      throw std::runtime_error("Screen requires bottom right!");
+    if (s.cameras.empty()) {
+      throw std::runtime_error("Scene requires a camera!");
     }
   } else {
-    throw std::runtime_error("Scene requires screen!");
+    s.cameras.push_back(parse_camera_node(config));
   }
+  s.camera = s.cameras.front();
 
   if (YAML::Node resolution = config["resolution"]) {
     s.res = parse_resolution_node(resolution);
@@ -405,23 +595,128 @@ scene_t load_scene_from_file(const char* scene_file) {
     throw std::runtime_error("Scene requires resolution!");
   }
 
+  if (YAML::Node crop = config["crop"]) {
+    s.crop = parse_crop_node(crop);
+    if (!s.crop.fits(s.res)) {
+      throw std::runtime_error("crop must be a non-empty part of the image!");
+    }
+  } else {
+    s.crop = { 0u, 0u, s.res.x, s.res.y };
+  }
+
   if (YAML::Node samples = config["samples"]) {
     s.sample_count = samples.as<unsigned>();
   } else {
     s.sample_count = 1u;
   }
+  if (s.sample_count == 0u) {
+    throw std::runtime_error("samples must be positive!");
+  }
+
+  if (YAML::Node samples = config["min_samples"]) {
+    s.min_sample_count = samples.as<unsigned>();
+    if (s.min_sample_count == 0u || s.min_sample_count > s.sample_count) {
+      throw std::runtime_error("min_samples must be between 1 and samples!");
+    }
+  } else {
+    s.min_sample_count = std::min(s.sample_count, 16u);
+  }
+
+  if (YAML::Node threshold = config["noise_threshold"]) {
+    s.noise_threshold = threshold.as<float>();
+    if (s.noise_threshold < 0.f) {
+      throw std::runtime_error("noise_threshold must not be negative!");
+    }
+  } else {
+    s.noise_threshold = 0.f;
+  }
+
+  if (YAML::Node integrator = config["integrator"]) {
+    s.integrator = parse_integrator_node(integrator);
+  } else if (YAML::Node enabled = config["photon_mapping"]) {
+    s.integrator = enabled.as<bool>() ? PHOTON_INTEGRATOR : WHITTED_INTEGRATOR;
+  } else {
+    s.integrator = WHITTED_INTEGRATOR;
+  }
+
+  if (YAML::Node sampler = config["sampler"]) {
+    s.sampler = parse_sampler_node(sampler);
+  } else {
+    s.sampler = RANDOM_SAMPLER;
+  }
+
+  if (YAML::Node radius = config["photon_radius"]) {
+    s.photon_radius = radius.as<float>();
+    if (s.photon_radius <= 0.f) {
+      throw std::runtime_error("photon_radius must be positive!");
+    }
+  } else {
+    s.photon_radius = 0.25f;
+  }
+
+  if (YAML::Node neighbors = config["photon_neighbors"]) {
+    s.photon_neighbors = neighbors.as<unsigned>();
+  } else {
+    s.photon_neighbors = 0u;
+  }
+
+  if (YAML::Node passes = config["photon_passes"]) {
+    s.photon_passes = passes.as<unsigned>();
+    if (s.photon_passes == 0u) {
+      throw std::runtime_error("photon_passes must be positive!");
+    }
+  } else {
+    s.photon_passes = 16u;
+  }
+
+  if (YAML::Node density = config["photon_density"]) {
+    s.photon_density = density.as<float>();
+    if (s.photon_density < 0.f) {
+      throw std::runtime_error("photon_density must not be negative!");
+    }
+  } else {
+    s.photon_density = 0.f;
+  }
+
+  if (YAML::Node error = config["irradiance_error"]) {
+    s.irradiance_error = error.as<float>();
+    if (s.irradiance_error < 0.f) {
+      throw std::runtime_error("irradiance_error must not be negative!");
+    }
+  } else {
+    s.irradiance_error = 0.f;
+  }
+
+  if (YAML::Node depth = config["roulette_depth"]) {
+    s.roulette_depth = depth.as<unsigned>();
+  } else {
+    s.roulette_depth = std::numeric_limits<unsigned>::max();
+  }
+  s.max_depth = std::numeric_limits<unsigned>::max();
 
-  if (YAML::Node enabled = config["photon_mapping"]) {
-    s.photon_mapping_enabled = enabled.as<bool>();
+  if (YAML::Node weight = config["min_ray_weight"]) {
+    s.min_ray_weight = weight.as<float>();
+    if (s.min_ray_weight < 0.f) {
+      throw std::runtime_error("min_ray_weight must not be negative!");
+    }
   } else {
-    s.photon_mapping_enabled = false;
+    s.min_ray_weight = 0.f;
   }
 
+  if (YAML::Node stochastic = config["stochastic_branching"]) {
+    s.stochastic_branching = stochastic.as<bool>();
+  } else {
+    s.stochastic_branching = false;
+  }
+
+  std::vector<light_link_names> sphere_link_names;
+  std::vector<light_link_names> mesh_link_names;
   if (YAML::Node geometry = config["geometry"]) {
     if (YAML::Node spheres = geometry["spheres"]) {
       for (auto it = spheres.begin(); it != spheres.end(); ++it) {
         s.geometry.spheres.push_back(parse_sphere_node(*it));
         s.sphere_materials.push_back(retrieve_optional_material(*it));
+        sphere_link_names.push_back(retrieve_optional_light_links(*it));
       }
     }
 
@@ -429,6 +724,7 @@ scene_t load_scene_from_file(const char* scene_file) {
       for (auto it = meshes.begin(); it != meshes.end(); ++it) {
         s.geometry.meshes.push_back(parse_mesh_node(*it));
         s.mesh_materials.push_back(retrieve_optional_material(*it));
+        mesh_link_names.push_back(retrieve_optional_light_links(*it));
       }
     }
   } else {
@@ -456,6 +752,21 @@ scene_t load_scene_from_file(const char* scene_file) {
     throw std::runtime_error("Scene requires lights!");
   }
 
+  float total_brightness = 0.f;
+  s.bounded_lights = false;
+  for (const light_t& light : s.lights) {
+    total_brightness += max_component(light.color);
+    s.light_cdf.push_back(total_brightness);
+    s.bounded_lights = s.bounded_lights || light.influence_radius > 0.f;
+  }
+
+  for (const light_link_names& names : sphere_link_names) {
+    s.sphere_light_links.push_back(resolve_light_links(names, s.lights));
+  }
+  for (const light_link_names& names : mesh_link_names) {
+    s.mesh_light_links.push_back(resolve_light_links(names, s.lights));
+  }
+
   return s;
 }
 
@@ -2,8 +2,10 @@
 #define SCENE_H
 
 #include <functional>
+#include <string>
 #include <vector>
 #include "geometry.h"
+#include "sampler.h"
 #include "texture.h"
 #include "vec3f.h"
 
@@ -12,11 +14,84 @@ struct resolution_t {
   unsigned y;
 };
 
+/* The part of the image that is rendered, from (x0, y0) up to but not
+   including (x1, y1).
+*/
+struct crop_t {
+  unsigned x0;
+  unsigned y0;
+  unsigned x1;
+  unsigned y1;
+
+  unsigned width() const {
+    return x1 - x0;
+  }
+
+  unsigned height() const {
+    return y1 - y0;
+  }
+
+  // whether this is a non-empty part of an image of the given resolution
+  bool fits(const resolution_t& res) const {
+    return x0 < x1 && y0 < y1 && x1 <= res.x && y1 <= res.y;
+  }
+
+  // whether this is all of an image of the given resolution
+  bool covers(const resolution_t& res) const {
+    return x0 == 0u && y0 == 0u && x1 == res.x && y1 == res.y;
+  }
+};
+
+/* A viewpoint: the observer's eye, and the window it sees the scene
+   through.
+*/
+struct camera_t {
+  std::string name; // set for each of a scene's cameras, to tell them apart
+  vec3f observer;
+  vec3f screen_top_left;
+  vec3f screen_top_right;
+  vec3f screen_bottom_right;
+};
+
 struct light_t {
   vec3f position;
   vec3f color;
-  unsigned intensity; // photon-mapping
+  float intensity; // photon-mapping
   unsigned photon_samples; // photon-mapping
+  // the points of a sphere light share the photons photon_density asks for
+  unsigned share_index;
+  unsigned share_count;
+  float influence_radius; // zero means unbounded
+  std::string name; // used for light linking
+};
+
+/* The fraction of a light's color that reaches a point at the given distance.
+   Lights without an influence radius reach everything unattenuated.
+   Otherwise, the light fades smoothly to exactly zero at the radius,
+   so anything beyond it can be skipped without changing the image.
+*/
+inline float light_falloff(const light_t& light, float distance) {
+  if (light.influence_radius <= 0.f) {
+    return 1.f;
+  }
+  float x = distance / light.influence_radius;
+  if (x >= 1.f) {
+    return 0.f;
+  }
+  float x2 = x * x;
+  float window = 1.f - x2 * x2;
+  return window * window;
+}
+
+/* The set of lights that illuminate an object.
+   An empty mask means every light in the scene.
+*/
+struct light_link_t {
+  bool illuminated_by(size_t light_idx) const {
+    return mask.empty() || mask[light_idx];
+  }
+
+  std::vector<bool> mask;
 };
 
 struct material_t {
@@ -33,21 +108,43 @@ struct material_t {
   tex3d_lookup_t texture;
 };
 
+enum integrator_t {
+  WHITTED_INTEGRATOR,
+  PHOTON_INTEGRATOR, // whitted, plus a photon map for caustics
+  PATH_INTEGRATOR,
+  PROGRESSIVE_PHOTON_INTEGRATOR, // whitted, plus caustics refined per pass
+};
+
 struct scene_t {
   resolution_t res;
-  unsigned sample_count;
-  bool photon_mapping_enabled;
+  crop_t crop; // the pixels rendered, all of them by default
+  unsigned sample_count; // the most samples taken per pixel
+  unsigned min_sample_count; // the fewest, with adaptive sampling
+  float noise_threshold; // if non-zero, pixels stop sampling this smooth
+  integrator_t integrator;
+  sampler_t sampler; // how pixels, lights and photons are sampled
+  float photon_radius; // the distance photons are gathered from
+  unsigned photon_neighbors; // if non-zero, gather only the nearest photons
+  unsigned photon_passes; // progressive photon mapping passes
+  float photon_density; // if non-zero, sizes each light's photon count
+  float irradiance_error; // if non-zero, indirect light is interpolated
+  unsigned roulette_depth; // secondary rays this deep play russian roulette
+  unsigned max_depth; // secondary rays this deep aren't traced, for previews
+  float min_ray_weight; // secondary rays contributing less are dropped
+  bool stochastic_branching; // trace only one of reflection and refraction
 
-  vec3f observer;
-  vec3f screen_top_left;
-  vec3f screen_top_right;
-  vec3f screen_bottom_right;
+  camera_t camera; // the camera rendered
+  std::vector<camera_t> cameras; // every camera, the first by default
 
   geometry_t geometry;
   std::vector<material_t> sphere_materials;
   std::vector<material_t> mesh_materials;
+  std::vector<light_link_t> sphere_light_links;
+  std::vector<light_link_t> mesh_light_links;
 
   std::vector<light_t> lights;
+  std::vector<float> light_cdf; // running total of light brightness
+  bool bounded_lights; // whether any light has an influence radius
   vec3f ambient_light;
 
   vec3f screen_offset_per_px_x() const;
@@ -55,12 +152,13 @@ struct scene_t {
 };
 
 inline vec3f scene_t::screen_offset_per_px_x() const {
-  vec3f screen_offset_x = screen_top_right - screen_top_left;
+  vec3f screen_offset_x = camera.screen_top_right - camera.screen_top_left;
   return screen_offset_x / (res.x + 1u);
 }
 
 inline vec3f scene_t::screen_offset_per_px_y() const {
-  vec3f screen_offset_y = screen_bottom_right - screen_top_right;
+  vec3f screen_offset_y = camera.screen_bottom_right -
+    camera.screen_top_right;
   return screen_offset_y / (res.y + 1u);
 }
 
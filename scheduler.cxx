@@ -0,0 +1,114 @@
+#include <algorithm>
+#include <cstdint>
+#include "scheduler.h"
+
+namespace {
+
+/* The distance along a Hilbert curve filling an n by n grid, where n is a
+   power of two, of the cell (x, y).
+*/
+uint64_t hilbert_index(unsigned n, unsigned x, unsigned y) {
+  uint64_t d = 0u;
+  for (unsigned s = n / 2u; s > 0u; s /= 2u) {
+    unsigned rx = (x & s) > 0u;
+    unsigned ry = (y & s) > 0u;
+    d += uint64_t(s) * s * ((3u * rx) ^ ry);
+    // rotate the quadrant so the curve continues from where it left off
+    if (ry == 0u) {
+      if (rx == 1u) {
+        x = s - 1u - x;
+        y = s - 1u - y;
+      }
+      std::swap(x, y);
+    }
+  }
+  return d;
+}
+
+} // namespace
+
+std::vector<tile_t> hilbert_tiles(unsigned width, unsigned height,
+  unsigned tile_size)
+{
+  tile_size = std::max(tile_size, 1u);
+  unsigned tiles_x = (width + tile_size - 1u) / tile_size;
+  unsigned tiles_y = (height + tile_size - 1u) / tile_size;
+  unsigned n = 1u;
+  while (n < tiles_x || n < tiles_y) {
+    n *= 2u;
+  }
+
+  std::vector<std::pair<uint64_t, tile_t>> ordered;
+  for (unsigned ty = 0u; ty < tiles_y; ++ty) {
+    for (unsigned tx = 0u; tx < tiles_x; ++tx) {
+      tile_t tile = { tx * tile_size, ty * tile_size,
+        std::min((tx + 1u) * tile_size, width),
+        std::min((ty + 1u) * tile_size, height) };
+      ordered.push_back(std::make_pair(hilbert_index(n, tx, ty), tile));
+    }
+  }
+  std::sort(ordered.begin(), ordered.end(),
+    [](const std::pair<uint64_t, tile_t>& lhs,
+      const std::pair<uint64_t, tile_t>& rhs) {
+      return lhs.first < rhs.first;
+    });
+
+  std::vector<tile_t> tiles;
+  for (const auto& entry : ordered) {
+    tiles.push_back(entry.second);
+  }
+  return tiles;
+}
+
+work_queues::work_queues(size_t task_count, unsigned thread_count)
+  : work_queues(task_count,
+      std::vector<unsigned>(std::max(thread_count, 1u), 0u))
+{
+}
+
+work_queues::work_queues(size_t task_count,
+  const std::vector<unsigned>& thread_nodes)
+  : nodes_(thread_nodes)
+{
+  if (nodes_.empty()) {
+    nodes_.push_back(0u);
+  }
+  size_t thread_count = nodes_.size();
+  for (size_t i = 0u; i < thread_count; ++i) {
+    queues_.push_back(std::unique_ptr<queue>(new queue));
+    size_t first = task_count * i / thread_count;
+    size_t last = task_count * (i + 1u) / thread_count;
+    for (size_t task = first; task < last; ++task) {
+      queues_.back()->tasks.push_back(task);
+    }
+  }
+}
+
+bool work_queues::next(unsigned thread_id, size_t& task) {
+  {
+    queue& own = *queues_[thread_id];
+    std::lock_guard<std::mutex> lock(own.mutex);
+    if (!own.tasks.empty()) {
+      task = own.tasks.front();
+      own.tasks.pop_front();
+      return true;
+    }
+  }
+  // the first round only visits threads on the same node
+  for (int same_node = 1; same_node >= 0; --same_node) {
+    for (size_t i = 1u; i < queues_.size(); ++i) {
+      size_t victim_id = (thread_id + i) % queues_.size();
+      if ((nodes_[victim_id] == nodes_[thread_id]) != bool(same_node)) {
+        continue;
+      }
+      queue& victim = *queues_[victim_id];
+      std::lock_guard<std::mutex> lock(victim.mutex);
+      if (!victim.tasks.empty()) {
+        task = victim.tasks.back();
+        victim.tasks.pop_back();
+        return true;
+      }
+    }
+  }
+  return false;
+}
@@ -0,0 +1,59 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/* A rectangle of pixels, from (x0, y0) up to but not including (x1, y1).
+*/
+struct tile_t {
+  unsigned x0;
+  unsigned y0;
+  unsigned x1;
+  unsigned y1;
+
+  unsigned width() const {
+    return x1 - x0;
+  }
+
+  unsigned height() const {
+    return y1 - y0;
+  }
+};
+
+/* Covers the image with square tiles of the given size, cropped at the
+   edges, ordered along a Hilbert curve so consecutive tiles are adjacent.
+*/
+std::vector<tile_t> hilbert_tiles(unsigned width, unsigned height,
+  unsigned tile_size);
+
+/* Hands out the tasks numbered [0, task_count) to threads. Each thread
+   starts with its own deque holding a contiguous share of the tasks, and
+   takes them from the front. Once its deque is empty, it steals from the
+   back of the others', taking the tasks furthest from what their owners
+   are working on. Given the NUMA node each thread runs on, it steals from
+   threads on its own node first, whose tasks' memory is closer.
+*/
+class work_queues {
+public:
+  work_queues(size_t task_count, unsigned thread_count);
+  work_queues(size_t task_count, const std::vector<unsigned>& thread_nodes);
+
+  /* Sets task to the next task for the thread, returning false once
+     there are none left anywhere.
+  */
+  bool next(unsigned thread_id, size_t& task);
+
+private:
+  struct queue {
+    std::mutex mutex;
+    std::deque<size_t> tasks;
+  };
+
+  std::vector<std::unique_ptr<queue>> queues_;
+  std::vector<unsigned> nodes_;
+};
+
+#endif
@@ -0,0 +1,34 @@
+#!/bin/sh
+# Checks that distributed renders match a single process's exactly.
+# Usage: test_distributed.sh <path to ray>
+RAY=$1
+SCENE=$(dirname "$0")/distributed.yml
+DIR=$(mktemp -d)
+trap 'rm -rf "$DIR"' EXIT
+
+render() {
+  OUTPUT=$1
+  shift
+  if ! "$RAY" --scene "$SCENE" --output "$DIR/$OUTPUT" "$@" >/dev/null 2>&1
+  then
+    echo "Distributed test failed: ray $* exited with an error"
+    exit 1
+  fi
+}
+
+same() {
+  if ! cmp -s "$DIR/single.png" "$DIR/$1"; then
+    echo "Distributed test failed: $1 differs from a single process's render"
+    exit 1
+  fi
+}
+
+render single.png --threads 2
+render workers.png --workers 3 --job-size 40
+same workers.png
+render queue.png --queue "$DIR/queue" --workers 2 --job-size 32
+same queue.png
+render crop.png --workers 2 --job-size 24 --crop 10,5,80,60 \
+  --composite "$DIR/single.png"
+same crop.png
+echo "Distributed tests passed."
@@ -0,0 +1,70 @@
+#include <cmath>
+#include "irradiance_cache.h"
+#include "vec3f.h"
+#include "test/test.h"
+
+namespace {
+
+const vec3f up(0,1,0);
+
+irradiance_record record_at(const vec3f& position, const vec3f& light) {
+  return irradiance_record{ position, up, light, 1.f, 0u, 0u };
+}
+
+irradiance_cache two_records() {
+  irradiance_cache cache(0.5f);
+  cache.build(std::vector<irradiance_record>{
+    record_at(vec3f(0,0,0), vec3f(1,1,1)),
+    record_at(vec3f(10,0,0), vec3f(3,3,3)) });
+  return cache;
+}
+
+// tests
+RTEST(irradiance_cache_empty, []{
+  irradiance_cache cache(0.5f);
+  vec3f light;
+  return !cache.interpolate(vec3f(0,0,0), up, 0u, light);
+}());
+
+RTEST(irradiance_cache_reuses_nearby_record, []{
+  irradiance_cache cache = two_records();
+  vec3f light(0,0,0);
+  return cache.interpolate(vec3f(0.2f,0,0.1f), up, 0u, light) &&
+    light == vec3f(1,1,1);
+}());
+
+RTEST(irradiance_cache_reuses_single_record, []{
+  irradiance_cache cache(0.5f);
+  cache.build(std::vector<irradiance_record>{
+    record_at(vec3f(0,0,0), vec3f(1,1,1)) });
+  vec3f light(0,0,0);
+  return cache.interpolate(vec3f(0.2f,0,0.1f), up, 0u, light) &&
+    light == vec3f(1,1,1);
+}());
+
+RTEST(irradiance_cache_blends_overlapping_records, []{
+  irradiance_cache cache(0.5f);
+  cache.build(std::vector<irradiance_record>{
+    record_at(vec3f(0,0,0), vec3f(1,1,1)),
+    record_at(vec3f(0.4f,0,0), vec3f(3,3,3)) });
+  vec3f light(0,0,0);
+  return cache.interpolate(vec3f(0.2f,0,0), up, 0u, light) &&
+    std::abs(light[0] - 2.f) < 1e-4f;
+}());
+
+RTEST(irradiance_cache_misses_far_or_other_objects, []{
+  irradiance_cache cache = two_records();
+  vec3f light;
+  return !cache.interpolate(vec3f(5,0,0), up, 0u, light) &&
+    !cache.interpolate(vec3f(0,0,0), up, 1u, light) &&
+    !cache.interpolate(vec3f(0,0,0), vec3f(1,0,0), 0u, light);
+}());
+
+} // namespace
+
+test_results test_irradiance_cache() {
+  return irradiance_cache_empty() % irradiance_cache_reuses_nearby_record() %
+    irradiance_cache_reuses_single_record() %
+    irradiance_cache_blends_overlapping_records() %
+    irradiance_cache_misses_far_or_other_objects();
+}
@@ -0,0 +1,118 @@
+#include <random>
+#include "kd_tree.h"
+#include "vec3f.h"
+#include "test/test.h"
+
+namespace {
+struct identity_position {
+  vec3f operator()(const vec3f& v) const {
+    return v;
+  }
+};
+
+typedef kd_tree<vec3f, identity_position> point_tree;
+
+std::vector<vec3f> random_points(size_t count) {
+  std::mt19937 engine(42u);
+  std::uniform_real_distribution<float> distribution(-1.f, 1.f);
+  std::vector<vec3f> points;
+  for (size_t i = 0u; i < count; ++i) {
+    float x = distribution(engine);
+    float y = distribution(engine);
+    float z = distribution(engine);
+    points.push_back(vec3f(x, y, z));
+  }
+  return points;
+}
+
+float dist_sq(const vec3f& lhs, const vec3f& rhs) {
+  vec3f d = lhs - rhs;
+  return dot(d, d);
+}
+
+// tests
+RTEST(kd_tree_empty, []{
+  point_tree tree;
+  size_t visited = 0u;
+  tree.for_each_within(vec3f(0,0,0), 1.f,
+    [&](const vec3f&, float) { ++visited; });
+  return tree.empty() && visited == 0u;
+}());
+
+RTEST(kd_tree_within_matches_brute_force, []{
+  std::vector<vec3f> points = random_points(1000u);
+  point_tree tree(points);
+  vec3f center(0.1f, -0.2f, 0.3f);
+  float radius = 0.4f;
+
+  size_t expected = std::count_if(points.begin(), points.end(),
+    [&](const vec3f& p) { return dist_sq(p, center) < radius * radius; });
+  size_t found = 0u;
+  bool all_inside = true;
+  tree.for_each_within(center, radius, [&](const vec3f& p, float d_sq) {
+    ++found;
+    all_inside = all_inside && d_sq < radius * radius &&
+      d_sq == dist_sq(p, center);
+  });
+  return expected > 0u && found == expected && all_inside;
+}());
+
+RTEST(kd_tree_nearest_matches_brute_force, []{
+  std::vector<vec3f> points = random_points(1000u);
+  point_tree tree(points);
+  vec3f center(-0.3f, 0.5f, 0.f);
+  const size_t k = 10u;
+
+  std::vector<float> distances;
+  for (const vec3f& p : points) {
+    distances.push_back(dist_sq(p, center));
+  }
+  std::sort(distances.begin(), distances.end());
+
+  std::vector<kd_neighbor<vec3f>> found;
+  tree.nearest(center, k, 10.f, found);
+  if (found.size() != k) {
+    return false;
+  }
+  for (size_t i = 0u; i < k; ++i) {
+    if (found[i].dist_sq != distances[i]) {
+      return false;
+    }
+  }
+  return true;
+}());
+
+RTEST(kd_tree_nearest_limited_by_radius, []{
+  std::vector<vec3f> points = random_points(1000u);
+  point_tree tree(points);
+  std::vector<kd_neighbor<vec3f>> found;
+  tree.nearest(vec3f(5,5,5), 10u, 1.f, found);
+  return found.empty();
+}());
+
+RTEST(kd_tree_restored_from_layout, []{
+  point_tree built(random_points(1000u));
+  point_tree restored(built.points(), built.axes());
+  vec3f center(0.2f, 0.2f, -0.1f);
+  std::vector<kd_neighbor<vec3f>> expected;
+  std::vector<kd_neighbor<vec3f>> found;
+  built.nearest(center, 10u, 10.f, expected);
+  restored.nearest(center, 10u, 10.f, found);
+  if (found.size() != expected.size()) {
+    return false;
+  }
+  for (size_t i = 0u; i < found.size(); ++i) {
+    if (*found[i].point != *expected[i].point) {
+      return false;
+    }
+  }
+  return true;
+}());
+
+} // namespace
+
+test_results test_kd_tree() {
+  return kd_tree_empty() % kd_tree_within_matches_brute_force() %
+    kd_tree_nearest_matches_brute_force() % kd_tree_nearest_limited_by_radius() %
+    kd_tree_restored_from_layout();
+}
@@ -14,10 +14,37 @@ const char* end_punctuation(size_t failure_count) {
 }
 
 extern test_results test_geometry();
+extern test_results test_kd_tree();
+extern test_results test_photon_hit();
+extern test_results test_photon_map();
+extern test_results test_irradiance_cache();
+extern test_results test_scheduler();
+extern test_results test_sampler();
+extern test_results test_thread_pool();
 extern int test_image();
 
 int main(int argc, char** argv) {
   test_results results = test_geometry();
+  test_results kd_tree_results = test_kd_tree();
+  results.insert(results.end(), kd_tree_results.begin(), kd_tree_results.end());
+  test_results photon_hit_results = test_photon_hit();
+  results.insert(results.end(), photon_hit_results.begin(),
+    photon_hit_results.end());
+  test_results photon_map_results = test_photon_map();
+  results.insert(results.end(), photon_map_results.begin(),
+    photon_map_results.end());
+  test_results irradiance_cache_results = test_irradiance_cache();
+  results.insert(results.end(), irradiance_cache_results.begin(),
+    irradiance_cache_results.end());
+  test_results scheduler_results = test_scheduler();
+  results.insert(results.end(), scheduler_results.begin(),
+    scheduler_results.end());
+  test_results sampler_results = test_sampler();
+  results.insert(results.end(), sampler_results.begin(),
+    sampler_results.end());
+  test_results thread_pool_results = test_thread_pool();
+  results.insert(results.end(), thread_pool_results.begin(),
+    thread_pool_results.end());
   auto end_it = std::remove_if(results.begin(), results.end(),
     [](const test_result& x)->bool{ return x.passed; });
   size_t failure_count = std::distance(results.begin(), end_it);
@@ -0,0 +1,54 @@
+#include <cmath>
+#include "photon_hit.h"
+#include "vec3f.h"
+#include "test/test.h"
+
+namespace {
+
+bool near(const vec3f& lhs, const vec3f& rhs, float epsilon) {
+  return magnitude(lhs - rhs) <= epsilon;
+}
+
+const photon_position unit_box(vec3f(-1,-1,-1), vec3f(1,1,1));
+
+const vec3f test_directions[] = {
+  normalized(vec3f(1,2,3)), normalized(vec3f(-1,-2,-3)),
+  normalized(vec3f(0.3f,-1,0.1f)), vec3f(0,0,-1), vec3f(0,1,0) };
+
+// tests
+RTEST(photon_hit_is_compact, []{
+  return sizeof(photon_hit) == 12u;
+}());
+
+RTEST(photon_hit_position_round_trip, []{
+  vec3f position(0.25f, -0.7f, 0.999f);
+  photon_hit photon = photon_hit::pack(vec3f(0,-1,0), vec3f(1,1,1));
+  photon.place(unit_box, position);
+  return near(unit_box(photon), position, 1e-4f);
+}());
+
+RTEST(photon_hit_direction_round_trip, []{
+  for (const vec3f& direction : test_directions) {
+    photon_hit photon = photon_hit::pack(direction, vec3f(1,1,1));
+    if (!near(photon.direction(), direction, 0.02f)) {
+      return false;
+    }
+  }
+  return true;
+}());
+
+RTEST(photon_hit_color_round_trip, []{
+  vec3f color(3e-5f, 1e-5f, 0.f);
+  photon_hit photon = photon_hit::pack(vec3f(0,-1,0), color);
+  vec3f decoded = photon.color();
+  return std::abs(decoded[0] - color[0]) <= 0.01f * color[0] &&
+    std::abs(decoded[1] - color[1]) <= 0.02f * color[1] &&
+    decoded[2] < 0.01f * color[0];
+}());
+
+} // namespace
+
+test_results test_photon_hit() {
+  return photon_hit_is_compact() % photon_hit_position_round_trip() %
+    photon_hit_direction_round_trip() % photon_hit_color_round_trip();
+}
@@ -0,0 +1,76 @@
+#include <cstring>
+#include "photon_map.h"
+#include "thread_pool.h"
+#include "test/test.h"
+
+namespace {
+
+material_t material_with_opacity(float opacity) {
+  material_t material = material_t();
+  material.color = vec3f(1,1,1);
+  material.opacity = opacity;
+  material.refractive_index = 1.5f;
+  return material;
+}
+
+/* A glass ball above a floor, lit from the given position by a light
+   that sizes its photon count by density.
+*/
+scene_t glass_ball_scene(const vec3f& light_position) {
+  scene_t s = scene_t();
+  s.integrator = PHOTON_INTEGRATOR;
+  s.sampler = RANDOM_SAMPLER;
+  s.photon_density = 1000.f;
+  s.geometry.spheres.push_back(
+    sphere_t::from_center_radius_squared(vec3f(0,0,0), 1.f));
+  s.sphere_materials.push_back(material_with_opacity(0.f));
+  s.geometry.spheres.push_back(
+    sphere_t::from_center_radius_squared(vec3f(0,-102,0), 10000.f));
+  s.sphere_materials.push_back(material_with_opacity(1.f));
+  s.sphere_light_links.resize(s.geometry.spheres.size());
+
+  light_t light = light_t();
+  light.position = light_position;
+  light.color = vec3f(1,1,1);
+  light.intensity = 100.f;
+  light.photon_samples = 1000u;
+  light.share_index = 0u;
+  light.share_count = 1u;
+  light.influence_radius = 0.f;
+  s.lights.push_back(light);
+  return s;
+}
+
+// tests
+
+RTEST(photon_map_light_inside_translucent_bounds, []{
+  // every photon leaves through the ball, so its surface sizes the count
+  scene_t s = glass_ball_scene(vec3f(0,0,0));
+  thread_pool pool(1u, false, read_cpu_topology());
+  photon_map map = trace_photons(s, 0u, pool);
+  return map.sphere_photons.size() == 2u &&
+    map.sphere_photons[1].size() > 0u;
+}());
+
+RTEST(photon_map_same_for_any_thread_count, []{
+  // photons are seeded by batch, not by the thread that traces them;
+  // enough photons for several batches
+  scene_t s = glass_ball_scene(vec3f(0,5,0));
+  s.photon_density = 10000.f;
+  thread_pool one_thread(1u, false, read_cpu_topology());
+  thread_pool four_threads(4u, false, read_cpu_topology());
+  photon_map one = trace_photons(s, 0u, one_thread);
+  photon_map four = trace_photons(s, 0u, four_threads);
+  return !one.photons.empty() &&
+    one.photons.size() == four.photons.size() &&
+    !memcmp(one.photons.data(), four.photons.data(),
+      one.photons.size() * sizeof(photon_hit)) &&
+    one.axes == four.axes;
+}());
+
+} // namespace
+
+test_results test_photon_map() {
+  return photon_map_light_inside_translucent_bounds() %
+    photon_map_same_for_any_thread_count();
+}
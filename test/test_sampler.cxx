@@ -0,0 +1,123 @@
+#include <vector>
+#include "sampler.h"
+#include "test/test.h"
+
+namespace {
+
+/* Whether the first count samples of the pattern put exactly one sample
+   in each of count equal intervals of every dimension up to dimensions.
+*/
+bool stratifies_each_dimension(sampler_t type, unsigned count,
+  unsigned dimensions)
+{
+  sampler samples(type);
+  std::vector<std::vector<unsigned>> hits(dimensions,
+    std::vector<unsigned>(count, 0u));
+  for (unsigned i = 0u; i < count; ++i) {
+    samples.start_sample(7u, i, count);
+    for (unsigned d = 0u; d < dimensions; ++d) {
+      float x = samples();
+      if (x < 0.f || x >= 1.f) {
+        return false;
+      }
+      ++hits[d][unsigned(x * count)];
+    }
+  }
+  for (const std::vector<unsigned>& dimension : hits) {
+    for (unsigned n : dimension) {
+      if (n != 1u) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+/* Whether the first 16 samples put exactly one sample in each cell of a
+   4 by 4 grid over the first two dimensions.
+*/
+bool stratifies_pixel(sampler_t type) {
+  sampler samples(type);
+  std::vector<unsigned> cells(16u, 0u);
+  for (unsigned i = 0u; i < 16u; ++i) {
+    samples.start_sample(3u, i, 16u);
+    unsigned x = unsigned(samples() * 4.f);
+    unsigned y = unsigned(samples() * 4.f);
+    ++cells[y * 4u + x];
+  }
+  for (unsigned n : cells) {
+    if (n != 1u) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// tests
+RTEST(rng_advance_matches_stepping, []{
+  uniform_rng stepped(42u, 7u);
+  uniform_rng jumped(42u, 7u);
+  for (unsigned i = 0u; i < 1000u; ++i) {
+    stepped.next();
+  }
+  jumped.advance(1000u);
+  return stepped.next() == jumped.next();
+}());
+
+RTEST(rng_streams_differ, []{
+  uniform_rng first(42u, 1u);
+  uniform_rng second(42u, 2u);
+  unsigned matches = 0u;
+  for (unsigned i = 0u; i < 100u; ++i) {
+    matches += first.next() == second.next();
+  }
+  return matches == 0u;
+}());
+
+RTEST(permute_is_a_permutation, []{
+  for (unsigned count : { 1u, 5u, 16u, 100u }) {
+    std::vector<unsigned> seen(count, 0u);
+    for (unsigned i = 0u; i < count; ++i) {
+      ++seen[sampling::permute(i, count, 1234u)];
+    }
+    for (unsigned n : seen) {
+      if (n != 1u) {
+        return false;
+      }
+    }
+  }
+  return true;
+}());
+
+RTEST(sobol_matches_known_points, sampling::sobol(1u, 0u) == 0x80000000u &&
+  sampling::sobol(2u, 1u) == 0xc0000000u &&
+  sampling::sobol(3u, 0u) == 0xc0000000u &&
+  sampling::sobol(3u, 1u) == 0x40000000u);
+
+RTEST(radical_inverse_reverses_digits,
+  sampling::radical_inverse(2u, 1u) == 0.5f &&
+  sampling::radical_inverse(2u, 3u) == 0.75f &&
+  sampling::radical_inverse(3u, 1u) == 1.f / 3.f);
+
+RTEST(stratified_and_sobol_stratify_each_dimension,
+  stratifies_each_dimension(STRATIFIED_SAMPLER, 13u, 6u) &&
+  stratifies_each_dimension(SOBOL_SAMPLER, 32u, 6u));
+
+RTEST(sobol_stratifies_pixels, stratifies_pixel(SOBOL_SAMPLER));
+
+RTEST(sampler_names_round_trip, []{
+  sampler_t type = RANDOM_SAMPLER;
+  return sampler_from_name("sobol", type) && type == SOBOL_SAMPLER &&
+    sampler_from_name("halton", type) && type == HALTON_SAMPLER &&
+    !sampler_from_name("blue", type);
+}());
+
+} // namespace
+
+test_results test_sampler() {
+  return rng_advance_matches_stepping() % rng_streams_differ() %
+    permute_is_a_permutation() % sobol_matches_known_points() %
+    radical_inverse_reverses_digits() %
+    stratified_and_sobol_stratify_each_dimension() %
+    sobol_stratifies_pixels() % sampler_names_round_trip();
+}
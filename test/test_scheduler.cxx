@@ -0,0 +1,88 @@
+#include <cstdlib>
+#include <vector>
+#include "scheduler.h"
+#include "test/test.h"
+
+namespace {
+
+bool covers_each_pixel_once(unsigned width, unsigned height,
+  unsigned tile_size)
+{
+  std::vector<unsigned> covered(width * height, 0u);
+  for (const tile_t& tile : hilbert_tiles(width, height, tile_size)) {
+    for (unsigned y = tile.y0; y < tile.y1; ++y) {
+      for (unsigned x = tile.x0; x < tile.x1; ++x) {
+        ++covered[y * width + x];
+      }
+    }
+  }
+  for (unsigned count : covered) {
+    if (count != 1u) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// tests
+RTEST(hilbert_tiles_cover_image, covers_each_pixel_once(64, 64, 16) &&
+  covers_each_pixel_once(100, 37, 16) && covers_each_pixel_once(5, 3, 32));
+
+RTEST(hilbert_tiles_are_adjacent, []{
+  std::vector<tile_t> tiles = hilbert_tiles(128, 128, 16);
+  for (size_t i = 1u; i < tiles.size(); ++i) {
+    int dx = std::abs(int(tiles[i].x0) - int(tiles[i - 1u].x0));
+    int dy = std::abs(int(tiles[i].y0) - int(tiles[i - 1u].y0));
+    if (dx + dy != 16) {
+      return false;
+    }
+  }
+  return tiles.size() == 64u;
+}());
+
+RTEST(work_queues_hand_out_each_task_once, []{
+  work_queues queues(10u, 3u);
+  std::vector<unsigned> handed_out(10u, 0u);
+  size_t task;
+  // the last thread takes its own tasks, then steals the rest
+  while (queues.next(2u, task)) {
+    ++handed_out[task];
+  }
+  for (unsigned count : handed_out) {
+    if (count != 1u) {
+      return false;
+    }
+  }
+  return !queues.next(0u, task);
+}());
+
+RTEST(work_queues_start_with_own_share, []{
+  work_queues queues(10u, 2u);
+  size_t first;
+  size_t second;
+  return queues.next(1u, first) && first == 5u &&
+    queues.next(0u, second) && second == 0u;
+}());
+
+RTEST(work_queues_steal_within_node_first, []{
+  std::vector<unsigned> nodes;
+  nodes.push_back(0u);
+  nodes.push_back(1u);
+  nodes.push_back(0u);
+  nodes.push_back(1u);
+  work_queues queues(8u, nodes);
+  size_t own_first;
+  size_t own_second;
+  size_t stolen;
+  // thread 0 holds tasks 0 and 1, and thread 2 on its node holds 4 and 5
+  return queues.next(0u, own_first) && queues.next(0u, own_second) &&
+    queues.next(0u, stolen) && stolen == 5u;
+}());
+
+} // namespace
+
+test_results test_scheduler() {
+  return hilbert_tiles_cover_image() % hilbert_tiles_are_adjacent() %
+    work_queues_hand_out_each_task_once() % work_queues_start_with_own_share() %
+    work_queues_steal_within_node_first();
+}
@@ -0,0 +1,78 @@
+#include <atomic>
+#include <vector>
+#include "thread_pool.h"
+#include "test/test.h"
+
+namespace {
+
+cpu_topology two_nodes() {
+  cpu_topology topology;
+  topology.node_ids.push_back(0u);
+  topology.node_ids.push_back(1u);
+  topology.node_cpus.push_back(std::vector<unsigned>(2u, 0u));
+  topology.node_cpus.push_back(std::vector<unsigned>(2u, 0u));
+  return topology;
+}
+
+const unsigned LISTED_CPUS[] = { 0u, 1u, 2u, 5u, 8u, 9u };
+const unsigned ALTERNATING_NODES[] = { 0u, 1u, 0u };
+
+// tests
+RTEST(parse_cpu_list_reads_ranges, []{
+  std::vector<unsigned> cpus;
+  bool parsed = parse_cpu_list("0-2,5,8-9\n", cpus);
+  return parsed && cpus == std::vector<unsigned>(LISTED_CPUS,
+    LISTED_CPUS + 6);
+}());
+
+RTEST(parse_cpu_list_rejects_garbage, []{
+  std::vector<unsigned> cpus;
+  return !parse_cpu_list("0-", cpus) && !parse_cpu_list("3-1", cpus) &&
+    !parse_cpu_list("a", cpus);
+}());
+
+RTEST(cpu_topology_has_a_cpu, read_cpu_topology().cpu_count() > 0u);
+
+RTEST(thread_pool_runs_each_thread_every_job, []{
+  thread_pool pool(3u, false, read_cpu_topology());
+  std::vector<unsigned> runs(pool.size(), 0u);
+  for (unsigned job = 0u; job < 5u; ++job) {
+    pool.run([&](unsigned thread_id) { ++runs[thread_id]; });
+  }
+  return runs == std::vector<unsigned>(3u, 5u);
+}());
+
+RTEST(thread_pool_runs_jobs_concurrently, []{
+  // every thread waits for the others, so this only finishes if they all run
+  thread_pool pool(4u, false, read_cpu_topology());
+  std::atomic<unsigned> arrived(0u);
+  pool.run([&](unsigned) {
+    ++arrived;
+    while (arrived < 4u) {
+      std::this_thread::yield();
+    }
+  });
+  return arrived == 4u;
+}());
+
+RTEST(pinned_threads_alternate_nodes, []{
+  thread_pool pool(3u, true, two_nodes());
+  return pool.node_count() == 2u &&
+    pool.thread_nodes() == std::vector<unsigned>(ALTERNATING_NODES,
+      ALTERNATING_NODES + 3);
+}());
+
+RTEST(unpinned_threads_share_a_node, []{
+  thread_pool pool(3u, false, two_nodes());
+  return pool.node_count() == 1u &&
+    pool.thread_nodes() == std::vector<unsigned>(3u, 0u);
+}());
+
+} // namespace
+
+test_results test_thread_pool() {
+  return parse_cpu_list_reads_ranges() % parse_cpu_list_rejects_garbage() %
+    cpu_topology_has_a_cpu() % thread_pool_runs_each_thread_every_job() %
+    thread_pool_runs_jobs_concurrently() % pinned_threads_alternate_nodes() %
+    unpinned_threads_share_a_node();
+}
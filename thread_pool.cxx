@@ -0,0 +1,217 @@
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include "thread_pool.h"
+
+#ifdef __linux__
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace {
+
+#ifdef __linux__
+
+const char* const NODE_DIR = "/sys/devices/system/node";
+
+// the node ids listed in NODE_DIR, in order
+std::vector<unsigned> system_node_ids() {
+  std::vector<unsigned> ids;
+  DIR* dir = opendir(NODE_DIR);
+  if (!dir) {
+    return ids;
+  }
+  while (dirent* entry = readdir(dir)) {
+    std::string name = entry->d_name;
+    if (name.compare(0, 4, "node") != 0 || name.size() == 4u ||
+      name.find_first_not_of("0123456789", 4) != std::string::npos)
+    {
+      continue;
+    }
+    ids.push_back(unsigned(std::atoi(name.c_str() + 4)));
+  }
+  closedir(dir);
+  std::sort(ids.begin(), ids.end());
+  return ids;
+}
+
+void pin_thread(std::thread& thread, unsigned cpu) {
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  // pinning is only an optimization, so a refusal isn't an error
+  pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set);
+}
+
+#endif
+
+} // namespace
+
+unsigned cpu_topology::cpu_count() const {
+  size_t count = 0u;
+  for (const auto& cpus : node_cpus) {
+    count += cpus.size();
+  }
+  return unsigned(count);
+}
+
+bool parse_cpu_list(const std::string& list, std::vector<unsigned>& cpus) {
+  std::istringstream input(list);
+  std::string range;
+  while (std::getline(input, range, ',')) {
+    range.erase(range.find_last_not_of(" \n") + 1u);
+    if (range.empty()) {
+      continue;
+    }
+    std::istringstream bounds(range);
+    unsigned first;
+    unsigned last;
+    char dash;
+    if (!(bounds >> first)) {
+      return false;
+    }
+    if (bounds >> dash) {
+      if (dash != '-' || !(bounds >> last) || last < first) {
+        return false;
+      }
+    } else {
+      last = first;
+    }
+    for (unsigned cpu = first; cpu <= last; ++cpu) {
+      cpus.push_back(cpu);
+    }
+  }
+  return true;
+}
+
+cpu_topology read_cpu_topology() {
+  cpu_topology topology;
+#ifdef __linux__
+  cpu_set_t allowed;
+  bool knows_allowed = sched_getaffinity(0, sizeof(allowed), &allowed) == 0;
+  for (unsigned id : system_node_ids()) {
+    std::ostringstream path;
+    path << NODE_DIR << "/node" << id << "/cpulist";
+    std::ifstream file(path.str().c_str());
+    std::string list;
+    std::vector<unsigned> listed;
+    if (!std::getline(file, list) || !parse_cpu_list(list, listed)) {
+      continue;
+    }
+    std::vector<unsigned> cpus;
+    for (unsigned cpu : listed) {
+      if (!knows_allowed || (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed))) {
+        cpus.push_back(cpu);
+      }
+    }
+    if (!cpus.empty()) {
+      topology.node_ids.push_back(id);
+      topology.node_cpus.push_back(cpus);
+    }
+  }
+  if (topology.node_cpus.empty() && knows_allowed) {
+    std::vector<unsigned> cpus;
+    for (unsigned cpu = 0u; cpu < CPU_SETSIZE; ++cpu) {
+      if (CPU_ISSET(cpu, &allowed)) {
+        cpus.push_back(cpu);
+      }
+    }
+    topology.node_ids.push_back(0u);
+    topology.node_cpus.push_back(cpus);
+  }
+#endif
+  if (topology.node_cpus.empty()) {
+    std::vector<unsigned> cpus;
+    for (unsigned cpu = 0u; cpu < std::thread::hardware_concurrency(); ++cpu) {
+      cpus.push_back(cpu);
+    }
+    if (cpus.empty()) {
+      cpus.push_back(0u);
+    }
+    topology.node_ids.push_back(0u);
+    topology.node_cpus.push_back(cpus);
+  }
+  return topology;
+}
+
+thread_pool::thread_pool(unsigned thread_count, bool pins,
+  const cpu_topology& topology)
+  : node_count_(1u)
+  , job_(0)
+  , job_number_(0u)
+  , running_(0u)
+  , stopping_(false)
+{
+  // take one CPU from each node in turn
+  std::vector<unsigned> cpus;
+  std::vector<unsigned> cpu_nodes;
+  for (size_t i = 0u; cpus.size() < topology.cpu_count(); ++i) {
+    for (size_t node = 0u; node < topology.node_cpus.size(); ++node) {
+      if (i < topology.node_cpus[node].size()) {
+        cpus.push_back(topology.node_cpus[node][i]);
+        cpu_nodes.push_back(unsigned(node));
+      }
+    }
+  }
+  pins = pins && !cpus.empty();
+  if (pins) {
+    node_count_ = unsigned(std::max<size_t>(topology.node_cpus.size(), 1u));
+  }
+
+  thread_count = std::max(thread_count, 1u);
+  for (unsigned thread_id = 0u; thread_id < thread_count; ++thread_id) {
+    nodes_.push_back(pins ? cpu_nodes[thread_id % cpus.size()] : 0u);
+    threads_.push_back(std::thread(&thread_pool::work, this, thread_id));
+#ifdef __linux__
+    if (pins) {
+      pin_thread(threads_.back(), cpus[thread_id % cpus.size()]);
+    }
+#endif
+  }
+}
+
+thread_pool::~thread_pool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  job_ready_.notify_all();
+  for (auto& thread : threads_) {
+    thread.join();
+  }
+}
+
+void thread_pool::run(const std::function<void(unsigned)>& job) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  job_ = &job;
+  ++job_number_;
+  running_ = unsigned(threads_.size());
+  job_ready_.notify_all();
+  job_done_.wait(lock, [this]{ return running_ == 0u; });
+  job_ = 0;
+}
+
+void thread_pool::work(unsigned thread_id) {
+  unsigned last_job = 0u;
+  for (;;) {
+    const std::function<void(unsigned)>* job;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      job_ready_.wait(lock, [&]{
+        return stopping_ || job_number_ != last_job;
+      });
+      if (stopping_) {
+        return;
+      }
+      last_job = job_number_;
+      job = job_;
+    }
+    (*job)(thread_id);
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (--running_ == 0u) {
+      job_done_.notify_all();
+    }
+  }
+}
@@ -0,0 +1,82 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/* The CPUs this process may run on, grouped by the NUMA node, typically
+   a socket, whose memory they're closest to.
+*/
+struct cpu_topology {
+  std::vector<unsigned> node_ids; // as numbered by the system
+  std::vector<std::vector<unsigned>> node_cpus;
+
+  unsigned cpu_count() const;
+};
+
+/* Reads the topology from /sys/devices/system/node, keeping only the
+   CPUs the process is allowed on. Where that's unavailable, all of the
+   hardware threads are taken to be on a single node.
+*/
+cpu_topology read_cpu_topology();
+
+/* Appends the CPUs in a list such as "0-3,8,10-11" to cpus, returning
+   false if it's malformed.
+*/
+bool parse_cpu_list(const std::string& list, std::vector<unsigned>& cpus);
+
+/* thread_pool - threads that are started once and reused for each job
+
+   Pinned threads are each tied to a CPU, spread across the nodes in turn
+   so that even a few threads use every node's memory bandwidth. Memory a
+   pinned thread allocates and fills is then placed on its node, and stays
+   close to it. Unpinned threads are all counted as being on node 0.
+*/
+class thread_pool {
+public:
+  thread_pool(unsigned thread_count, bool pins, const cpu_topology& topology);
+  ~thread_pool();
+
+  unsigned size() const {
+    return unsigned(threads_.size());
+  }
+
+  // the number of nodes threads run on, indexing topology's nodes
+  unsigned node_count() const {
+    return node_count_;
+  }
+
+  // the node each thread runs on
+  const std::vector<unsigned>& thread_nodes() const {
+    return nodes_;
+  }
+
+  /* Runs job(thread_id) once on every thread, returning when they've all
+     finished.
+  */
+  void run(const std::function<void(unsigned)>& job);
+
+private:
+  thread_pool(const thread_pool&);
+  thread_pool& operator=(const thread_pool&);
+
+  void work(unsigned thread_id);
+
+  std::vector<std::thread> threads_;
+  std::vector<unsigned> nodes_;
+  unsigned node_count_;
+
+  std::mutex mutex_;
+  std::condition_variable job_ready_;
+  std::condition_variable job_done_;
+  const std::function<void(unsigned)>* job_;
+  unsigned job_number_;
+  unsigned running_;
+  bool stopping_;
+};
+
+#endif
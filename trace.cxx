@@ -0,0 +1,648 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include "trace.h"
+
+namespace {
+
+/* normal: normalized direction from surface outwards
+   to_light: normalized direction from surface to light
+*/
+float matte(vec3f normal, vec3f to_light) {
+  return std::max(dot(normal, to_light), 0.f);
+}
+
+/* normal: normalized direction from surface outwards
+   to_light: normalized direction from surface to light
+   eye: normalized direction from eye to surface
+   n: the power to raise the specular component to (higher = shinier)
+*/
+float specular(vec3f normal, vec3f to_light, vec3f eye, float n) {
+  return std::pow(std::max(dot(eye, reflected(to_light, normal)), 0.f), n);
+}
+
+/* The nearest surface along a ray, whichever type of object it belongs to.
+*/
+struct surface_hit {
+  bool exists() const {
+    return nearest != NOTHING_NEAREST;
+  }
+
+  vec3f normal_at(const vec3f& position) const {
+    if (nearest == SPHERE_NEAREST) {
+      return rsi.near_geometry_it->normal_at(position);
+    } else {
+      return rmi.get_normal_at(position);
+    }
+  }
+
+  // numbered with spheres first, then meshes
+  uint32_t object_id(const scene_t& s) const {
+    if (nearest == SPHERE_NEAREST) {
+      return rsi.index_in(s.geometry.spheres);
+    } else {
+      return s.geometry.spheres.size() + rmi.index_in(s.geometry.meshes);
+    }
+  }
+
+  float photon_weight(float dist_sq) const {
+    return photon_kernel(nearest == MESH_NEAREST, dist_sq);
+  }
+
+  nearest_t nearest;
+  float t;
+  ray_sphere_intersect rsi;
+  ray_mesh_intersect rmi;
+  const material_t* material;
+  const light_link_t* links;
+  const photon_tree* photons;
+};
+
+surface_hit find_nearest_surface(const ray_t& ray, const scene_t& s) {
+  surface_hit hit;
+  hit.rsi = get_ray_sphere_intersect(ray, s.geometry.spheres);
+  hit.rmi = get_ray_mesh_intersect(ray, s.geometry.meshes);
+  hit.nearest = nearest_intersect(hit.rsi, s.geometry.spheres,
+    hit.rmi, s.geometry.meshes);
+  if (hit.nearest == SPHERE_NEAREST) {
+    size_t sphere_idx = hit.rsi.index_in(s.geometry.spheres);
+    hit.t = hit.rsi.t;
+    hit.material = &s.sphere_materials[sphere_idx];
+    hit.links = &s.sphere_light_links[sphere_idx];
+    hit.photons = &g_photon_map.sphere_photons[sphere_idx];
+  } else if (hit.nearest == MESH_NEAREST) {
+    size_t mesh_idx = hit.rmi.index_in(s.geometry.meshes);
+    hit.t = hit.rmi.t;
+    hit.material = &s.mesh_materials[mesh_idx];
+    hit.links = &s.mesh_light_links[mesh_idx];
+    hit.photons = &g_photon_map.mesh_photons[mesh_idx];
+  }
+  return hit;
+}
+
+/* Counts and times one ray of a profiled trace, or whatever else it does
+   while in scope. Without a profile, it does nothing.
+*/
+class ray_timer {
+public:
+  ray_timer(ray_profile* profile, ray_kind kind)
+    : profile_(profile)
+    , kind_(kind)
+  {
+    if (profile_) {
+      start_ = std::chrono::steady_clock::now();
+    }
+  }
+
+  ~ray_timer() {
+    if (profile_) {
+      std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start_;
+      ++profile_->counts[kind_];
+      profile_->seconds[kind_] += elapsed.count();
+    }
+  }
+
+private:
+  ray_profile* profile_;
+  ray_kind kind_;
+  std::chrono::steady_clock::time_point start_;
+};
+
+surface_hit find_profiled_surface(const ray_t& ray, const scene_t& s,
+  ray_kind kind, ray_profile* profile)
+{
+  ray_timer timer(profile, kind);
+  return find_nearest_surface(ray, s);
+}
+
+/* Shadow rays only need to know whether anything is in the way.
+*/
+bool is_occluded(const ray_t& ray, const scene_t& s, ray_profile* profile) {
+  return find_profiled_surface(ray, s, SHADOW_RAY, profile).exists();
+}
+
+enum light_visibility_t {
+  LIGHT_OUT_OF_REACH,
+  LIGHT_OCCLUDED,
+  LIGHT_VISIBLE,
+};
+
+/* Adds the light from one light source that a solid surface point reflects
+   back along the ray, unless the light is unlinked from the surface, out of
+   range, or blocked by other geometry.
+
+   pos: the point being shaded, backed off slightly towards the viewer
+*/
+light_visibility_t add_direct_light(const surface_hit& hit, const ray_t& ray,
+  const vec3f& pos, const scene_t& s, size_t light_idx, vec3f& light_color,
+  ray_profile* profile)
+{
+  const material_t& material = *hit.material;
+  const light_t& light = s.lights[light_idx];
+  // skip lights that can't contribute before casting any shadow ray
+  if (!hit.links->illuminated_by(light_idx)) {
+    return LIGHT_OUT_OF_REACH;
+  }
+  float falloff = light_falloff(light, magnitude(light.position - pos));
+  if (falloff <= 0.f) {
+    return LIGHT_OUT_OF_REACH;
+  }
+  ray_t light_ray = { pos, normalized(light.position - pos) };
+  if (is_occluded(light_ray, s, profile)) {
+    return LIGHT_OCCLUDED;
+  }
+  vec3f one_light_color = falloff * light.color;
+  if (material.k_matte > 0.f || material.k_specular > 0.f) {
+    // phong shading
+    vec3f normal = normalized(hit.normal_at(pos));
+    float matte_light = matte(normal, light_ray.direction);
+    float specular_light = specular(normal, light_ray.direction,
+      ray.direction, material.k_specular_n);
+    light_color += one_light_color *
+      (material.k_matte * matte_light +
+      material.k_specular * specular_light);
+  }
+  // normal / observer independant lighting
+  // it's fast and looks nice for some things
+  light_color += material.k_flat * one_light_color;
+  return LIGHT_VISIBLE;
+}
+
+/* Indirect light arriving at a surface point, and the distance over which
+   it's expected to vary little.
+*/
+struct indirect_estimate {
+  vec3f light;
+  float radius;
+};
+
+/* The light from the photons that landed near a surface point.
+
+   Photons are weighted by their distance from the point, as a fraction of
+   the gather radius. By default every photon within photon_radius counts.
+   With photon_neighbors set, only that many of the nearest photons count,
+   and where they are dense the radius shrinks to just enclose them, with
+   the result scaled up to keep the same brightness. Caustics stay sharp
+   where there are many photons and smooth where there are few.
+*/
+indirect_estimate gathered_photons(const surface_hit& hit,
+  const vec3f& intersect, const scene_t& s,
+  std::vector<kd_neighbor<photon_hit>>& neighbors)
+{
+  vec3f light_color(0,0,0);
+  // todo: do we need to account for the side we're on?
+  vec3f normal = normalized(hit.normal_at(intersect));
+  float radius_sq = s.photon_radius * s.photon_radius;
+  if (s.photon_neighbors == 0u) {
+    hit.photons->for_each_within(intersect, s.photon_radius,
+      [&](const photon_hit& photon, float dist_sq) {
+        light_color += photon.color() *
+          hit.photon_weight(dist_sq / radius_sq) *
+          matte(normal, -photon.direction());
+      });
+    return indirect_estimate{ light_color, s.photon_radius };
+  } else {
+    hit.photons->nearest(intersect, s.photon_neighbors, s.photon_radius,
+      neighbors);
+    float gather_radius_sq = neighbors.size() < s.photon_neighbors ?
+      radius_sq : neighbors.back().dist_sq;
+    if (gather_radius_sq <= 0.f) {
+      return indirect_estimate{ light_color, 0.f };
+    }
+    for (const kd_neighbor<photon_hit>& neighbor : neighbors) {
+      const photon_hit& photon = *neighbor.point;
+      light_color += photon.color() *
+        hit.photon_weight(neighbor.dist_sq / gather_radius_sq) *
+        matte(normal, -photon.direction());
+    }
+    light_color = light_color * (radius_sq / gather_radius_sq);
+    return indirect_estimate{ light_color, std::sqrt(gather_radius_sq) };
+  }
+}
+
+/* The indirect light at a surface point, from the estimator, or the
+   irradiance cache if it has records close enough. In the cache's prepass,
+   the estimate is always made and recorded. Any estimator returning an
+   indirect_estimate can be cached this way.
+*/
+template<class Estimator>
+vec3f cached_indirect_light(const surface_hit& hit, const vec3f& intersect,
+  const scene_t& s, trace_context& ctx, Estimator estimate)
+{
+  vec3f normal = normalized(hit.normal_at(intersect));
+  uint32_t object = hit.object_id(s);
+  if (ctx.irradiance_records) {
+    indirect_estimate result = estimate();
+    ctx.irradiance_records->push_back(irradiance_record{ intersect, normal,
+      result.light, result.radius, object, ctx.pixel });
+    return result.light;
+  }
+  vec3f light;
+  if (g_irradiance_cache.interpolate(intersect, normal, object, light)) {
+    return light;
+  }
+  return estimate().light;
+}
+
+/* Records a point for progressive photon mapping to gather photons at
+   later, instead of gathering them now.
+*/
+void record_gather_point(const surface_hit& hit, const vec3f& intersect,
+  const vec3f& weight, const scene_t& s, trace_context& ctx)
+{
+  gather_point point;
+  point.position = intersect;
+  point.normal = normalized(hit.normal_at(intersect));
+  point.weight = weight;
+  point.pixel = ctx.pixel;
+  point.on_mesh = hit.nearest == MESH_NEAREST;
+  point.obj_idx = point.on_mesh ? hit.rmi.index_in(s.geometry.meshes) :
+    hit.rsi.index_in(s.geometry.spheres);
+  point.radius_sq = s.photon_radius * s.photon_radius;
+  point.photon_count = 0.f;
+  point.flux = vec3f(0,0,0);
+  ctx.gather_points->push_back(point);
+}
+
+/* The light arriving at a solid surface point, from every light linked to
+   the surface, plus any photons that landed near it if it's shadowed from
+   at least one of them.
+
+   weight: how much of the light arriving here reaches the pixel
+*/
+vec3f incident_light(const surface_hit& hit, const ray_t& ray,
+  const vec3f& pos, const vec3f& weight, const scene_t& s,
+  trace_context& ctx)
+{
+  vec3f light_color(0,0,0);
+  bool is_shadowed = false;
+  for (size_t light_idx = 0u; light_idx < s.lights.size(); ++light_idx) {
+    if (add_direct_light(hit, ray, pos, s, light_idx, light_color,
+      ctx.profile) ==
+      LIGHT_OCCLUDED)
+    {
+      is_shadowed = true;
+    }
+  }
+  if (is_shadowed && ctx.gather_points) {
+    record_gather_point(hit, ray.position_at(hit.t), weight, s, ctx);
+  } else if (is_shadowed && !hit.photons->empty()) {
+    vec3f intersect = ray.position_at(hit.t);
+    light_color += cached_indirect_light(hit, intersect, s, ctx, [&] {
+      ray_timer timer(ctx.profile, PHOTON_GATHER);
+      return gathered_photons(hit, intersect, s, ctx.photon_neighbors);
+    });
+  }
+  return light_color;
+}
+
+// whether the light may reach the point, judged before casting any ray
+bool light_reaches(const surface_hit& hit, const vec3f& pos,
+  const scene_t& s, size_t light_idx)
+{
+  const light_t& light = s.lights[light_idx];
+  return hit.links->illuminated_by(light_idx) &&
+    light_falloff(light, magnitude(light.position - pos)) > 0.f;
+}
+
+float light_brightness(const scene_t& s, size_t light_idx) {
+  return s.light_cdf[light_idx] -
+    (light_idx > 0u ? s.light_cdf[light_idx - 1u] : 0.f);
+}
+
+/* Next-event estimation: the light arriving at a solid surface point from
+   a single light, picked in proportion to its brightness, and scaled by
+   the inverse of that probability so that on average it matches the light
+   from all of them. Lights unlinked from the surface or out of range of
+   the point are never picked.
+*/
+vec3f sampled_light(const surface_hit& hit, const ray_t& ray,
+  const vec3f& pos, const scene_t& s, trace_context& ctx)
+{
+  vec3f light_color(0,0,0);
+  if (s.light_cdf.empty() || s.light_cdf.back() <= 0.f) {
+    return light_color;
+  }
+  float choice = ctx.rng();
+  size_t light_idx;
+  float probability;
+  if (hit.links->mask.empty() && !s.bounded_lights) {
+    // every light may reach the point, so pick from the scene's totals
+    float total = s.light_cdf.back();
+    auto it = std::upper_bound(s.light_cdf.begin(), s.light_cdf.end(),
+      choice * total);
+    if (it == s.light_cdf.end()) {
+      --it;
+    }
+    light_idx = std::distance(s.light_cdf.begin(), it);
+    probability = light_brightness(s, light_idx) / total;
+  } else {
+    float total = 0.f;
+    for (size_t i = 0u; i < s.lights.size(); ++i) {
+      if (light_reaches(hit, pos, s, i)) {
+        total += light_brightness(s, i);
+      }
+    }
+    if (total <= 0.f) {
+      return light_color;
+    }
+    choice *= total;
+    light_idx = s.lights.size();
+    for (size_t i = 0u; i < s.lights.size(); ++i) {
+      if (!light_reaches(hit, pos, s, i)) {
+        continue;
+      }
+      light_idx = i;
+      if (choice < light_brightness(s, i)) {
+        break;
+      }
+      choice -= light_brightness(s, i);
+    }
+    probability = light_brightness(s, light_idx) / total;
+  }
+  add_direct_light(hit, ray, pos, s, light_idx, light_color, ctx.profile);
+  return light_color / probability;
+}
+
+/* Returns a direction in the hemisphere around the normal, with a
+   probability proportional to the cosine of its angle to the normal.
+*/
+vec3f cosine_weighted_direction(const vec3f& normal, sampler& rng) {
+  vec3f axis = std::abs(normal.x()) > 0.9f ? vec3f(0,1,0) : vec3f(1,0,0);
+  vec3f tangent = normalized(cross(axis, normal));
+  vec3f bitangent = cross(normal, tangent);
+
+  float u1 = rng();
+  float u2 = rng();
+  float r = std::sqrt(u1);
+  float phi = 2.f * float(M_PI) * u2;
+  float z = std::sqrt(std::max(0.f, 1.f - u1));
+  return r * std::cos(phi) * tangent + r * std::sin(phi) * bitangent +
+    z * normal;
+}
+
+/* Decides whether a secondary ray is worth tracing, given the weight its
+   color would contribute. Rays too faint to matter are dropped outright.
+   Beyond the roulette depth, the remaining rays survive with a probability
+   proportional to their weight, and survivors are boosted to compensate,
+   so the expected color is unchanged.
+*/
+bool survives(vec3f& throughput, unsigned depth, const scene_t& s,
+  sampler& rng)
+{
+  float weight = max_component(throughput);
+  if (weight < s.min_ray_weight) {
+    return false;
+  }
+  if (depth >= s.roulette_depth && weight < 1.f) {
+    if (rng() >= weight) {
+      return false;
+    }
+    throughput /= weight;
+  }
+  return true;
+}
+
+/* Keeps only one of a surface's reflected and refracted rays, picked with
+   probability proportional to its weight. The survivor's weight is divided
+   by that probability, so the expected color is the same as tracing both,
+   but the number of rays grows linearly with depth instead of doubling.
+*/
+void choose_branch(vec3f& reflect_throughput, bool& reflects,
+  vec3f& refract_throughput, bool& refracts, sampler& rng)
+{
+  float reflect_weight = max_component(reflect_throughput);
+  float refract_weight = max_component(refract_throughput);
+  float total_weight = reflect_weight + refract_weight;
+  if (total_weight <= 0.f) {
+    reflects = false;
+    refracts = false;
+    return;
+  }
+
+  float p_reflect = reflect_weight / total_weight;
+  if (rng() < p_reflect) {
+    reflect_throughput /= p_reflect;
+    refracts = false;
+  } else {
+    refract_throughput /= 1.f - p_reflect;
+    reflects = false;
+  }
+}
+
+/* Whitted-style ray tracing: direct light at every surface, plus
+  reflection and refraction, optionally with the photon map for caustics.
+
+  Rather than recursing into itself for each reflection and refraction, the
+  rays still to be traced are kept on an explicit stack, each carrying the
+  weight its color contributes to the result. A surface adds its own
+  shading scaled by the weight of the ray that hit it, then pushes its
+  secondary rays with that weight attenuated by the material. Since the
+  color is a weighted sum of the rays in the tree, the result is the same
+  as tracing the tree recursively, but native stack usage doesn't grow with
+  ray depth.
+
+  Note that these casts do not account for indirect lighting,
+  i.e. global illumination, except through the photon map.
+*/
+vec3f trace_whitted(const ray_t& ray,
+  const scene_t& s,
+  vec3f background,
+  trace_context& ctx)
+{
+  ray_stack& stack = ctx.stack;
+  const unsigned max_depth = std::min(MAX_RECURSE, s.max_depth);
+  vec3f color(0,0,0);
+  stack.clear();
+  stack.push_back(ray_task{ ray, vec3f(1,1,1), 1.f, 0u });
+  while (!stack.empty()) {
+    const ray_task task = stack.back();
+    stack.pop_back();
+
+    surface_hit hit = find_profiled_surface(task.ray, s,
+      task.depth == 0u ? CAMERA_RAY : SECONDARY_RAY, ctx.profile);
+    if (!hit.exists()) {
+      color += task.throughput * background;
+      continue;
+    }
+
+    const material_t& material = *hit.material;
+    float solid_component = material.opacity - material.reflectivity;
+    vec3f pos = task.ray.position_at(hit.t - BACKOFF);
+    if (solid_component > 0.f) {
+      vec3f material_color = material.texture ?
+        material.texture(pos) : material.color;
+      vec3f weight = task.throughput * (solid_component * material_color);
+      vec3f light_color = incident_light(hit, task.ray, pos, weight, s, ctx);
+      // add the combined flat/specular/matte lights wih ambient light
+      color += weight * (light_color + material.k_ambient * s.ambient_light);
+    }
+
+    vec3f reflect_throughput =
+      task.throughput * (material.reflectivity * material.color);
+    bool reflects = material.reflectivity > 0.f && task.depth < max_depth;
+
+    float translucence = 1.f - material.opacity;
+    vec3f refract_throughput =
+      task.throughput * (translucence * material.color);
+    bool refracts = translucence > 0.f;
+    if (refracts && task.depth >= max_depth) {
+      if (max_depth == MAX_RECURSE) {
+        std::cerr << "Hit max recurse depth!" << std::endl;
+      }
+      refracts = false;
+    }
+
+    if (reflects && refracts && s.stochastic_branching) {
+      choose_branch(reflect_throughput, reflects,
+        refract_throughput, refracts, ctx.rng);
+    }
+
+    if (reflects && survives(reflect_throughput, task.depth + 1u, s, ctx.rng)) {
+      vec3f normal = hit.normal_at(pos);
+      ray_t reflected_ray = { pos, reflected(task.ray.direction, normal) };
+      stack.push_back(ray_task{ reflected_ray, reflect_throughput,
+        task.refractive_index, task.depth + 1u });
+    }
+
+    if (refracts && survives(refract_throughput, task.depth + 1u, s, ctx.rng)) {
+      vec3f inside_pos = task.ray.position_at(hit.t + BACKOFF);
+      vec3f normal = hit.normal_at(inside_pos);
+      if (dot(task.ray.direction, normal) > 0.f) {
+        normal = -normal;
+      }
+      ray_t refracted_ray = { inside_pos, refracted(task.ray.direction,
+        normal, task.refractive_index, material.refractive_index) };
+      stack.push_back(ray_task{ refracted_ray, refract_throughput,
+        material.refractive_index, task.depth + 1u });
+    }
+  }
+  return color;
+}
+
+/* Unidirectional path tracing with next-event estimation.
+
+  Each surface along the path adds its ambient glow and the light from one
+  sampled light source. The path then continues in a single direction:
+  a cosine-weighted diffuse bounce, the mirror reflection, or the
+  refraction, picked in proportion to how much each contributes. Diffuse
+  interreflection comes from the bounces, so it needs no photon map, and
+  noise falls as samples are added.
+*/
+vec3f trace_path(const ray_t& ray,
+  const scene_t& s,
+  vec3f background,
+  trace_context& ctx)
+{
+  const unsigned max_depth = std::min(MAX_RECURSE, s.max_depth);
+  vec3f color(0,0,0);
+  ray_task task = { ray, vec3f(1,1,1), 1.f, 0u };
+  for (;;) {
+    surface_hit hit = find_profiled_surface(task.ray, s,
+      task.depth == 0u ? CAMERA_RAY : SECONDARY_RAY, ctx.profile);
+    if (!hit.exists()) {
+      color += task.throughput * background;
+      break;
+    }
+
+    const material_t& material = *hit.material;
+    float solid_component = material.opacity - material.reflectivity;
+    vec3f pos = task.ray.position_at(hit.t - BACKOFF);
+    vec3f diffuse_throughput(0,0,0);
+    if (solid_component > 0.f) {
+      vec3f material_color = material.texture ?
+        material.texture(pos) : material.color;
+      vec3f light_color = sampled_light(hit, task.ray, pos, s, ctx);
+      color += task.throughput * (solid_component * material_color *
+        (light_color + material.k_ambient * s.ambient_light));
+      diffuse_throughput = task.throughput *
+        (solid_component * material.k_matte * material_color);
+    }
+
+    if (task.depth >= max_depth) {
+      break;
+    }
+
+    vec3f reflect_throughput =
+      task.throughput * (material.reflectivity * material.color);
+    float translucence = std::max(1.f - material.opacity, 0.f);
+    vec3f refract_throughput =
+      task.throughput * (translucence * material.color);
+
+    float diffuse_weight = max_component(diffuse_throughput);
+    float reflect_weight = max_component(reflect_throughput);
+    float refract_weight = max_component(refract_throughput);
+    float total_weight = diffuse_weight + reflect_weight + refract_weight;
+    if (total_weight <= 0.f) {
+      break;
+    }
+
+    ray_task next = task;
+    next.depth = task.depth + 1u;
+    float choice = ctx.rng() * total_weight;
+    if (choice < diffuse_weight) {
+      vec3f normal = normalized(hit.normal_at(pos));
+      if (dot(task.ray.direction, normal) > 0.f) {
+        normal = -normal;
+      }
+      next.ray = { pos, cosine_weighted_direction(normal, ctx.rng) };
+      next.throughput = diffuse_throughput * (total_weight / diffuse_weight);
+    } else if (choice < diffuse_weight + reflect_weight) {
+      vec3f normal = hit.normal_at(pos);
+      next.ray = { pos, reflected(task.ray.direction, normal) };
+      next.throughput = reflect_throughput * (total_weight / reflect_weight);
+    } else {
+      vec3f inside_pos = task.ray.position_at(hit.t + BACKOFF);
+      vec3f normal = hit.normal_at(inside_pos);
+      if (dot(task.ray.direction, normal) > 0.f) {
+        normal = -normal;
+      }
+      next.ray = { inside_pos, refracted(task.ray.direction,
+        normal, task.refractive_index, material.refractive_index) };
+      next.throughput = refract_throughput * (total_weight / refract_weight);
+      next.refractive_index = material.refractive_index;
+    }
+
+    if (!survives(next.throughput, next.depth, s, ctx.rng)) {
+      break;
+    }
+    task = next;
+  }
+  return color;
+}
+
+} // namespace
+
+/* Casts a ray into the scene and returns a color, using the scene's
+  integrator. The background color is returned if no object is hit.
+*/
+vec3f cast_ray(const ray_t& ray,
+  const scene_t& s,
+  vec3f background,
+  trace_context& ctx)
+{
+  if (s.integrator == PATH_INTEGRATOR) {
+    return trace_path(ray, s, background, ctx);
+  } else {
+    return trace_whitted(ray, s, background, ctx);
+  }
+}
+
+double ray_timing_overhead() {
+  // the fastest of several rounds, in case one is interrupted
+  const unsigned rounds = 10u;
+  const unsigned timings = 100u;
+  double fastest = std::numeric_limits<double>::infinity();
+  for (unsigned round = 0u; round < rounds; ++round) {
+    ray_profile profile;
+    for (unsigned i = 0u; i < timings; ++i) {
+      ray_timer timer(&profile, CAMERA_RAY);
+    }
+    fastest = std::min(fastest, profile.seconds[CAMERA_RAY] / timings);
+  }
+  return fastest;
+}
@@ -0,0 +1,101 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <vector>
+#include "geometry.h"
+#include "irradiance_cache.h"
+#include "kd_tree.h"
+#include "photon_map.h"
+#include "sampler.h"
+#include "scene.h"
+#include "vec3f.h"
+
+// The maximum depth of secondary rays
+const unsigned MAX_RECURSE = 10u;
+
+// The distance along the ray that the collision is offset by,
+// to ensure floating point inaccuracy doesn't result in recollision
+// with the same surface upon recasting from the collision point.
+// Overall, it's a bit of a hack. A backoff algorithm would be more
+// appropriate.
+const float BACKOFF = 1e-3f;
+
+/* A ray waiting to be traced, along with the weight its color contributes
+   to the color of the ray that started the trace.
+*/
+struct ray_task {
+  ray_t ray;
+  vec3f throughput;
+  float refractive_index;
+  unsigned depth;
+};
+
+/* The rays still to be traced. Each rendering thread keeps its own,
+   so tracing a pixel neither allocates nor recurses.
+*/
+typedef std::vector<ray_task> ray_stack;
+
+// the kinds of work a profiled trace is counted and timed by
+enum ray_kind {
+  CAMERA_RAY,
+  SECONDARY_RAY, // reflected, refracted, or bounced by path tracing
+  SHADOW_RAY,
+  PHOTON_GATHER, // not a ray, but a search of the photon map
+  RAY_KIND_COUNT,
+};
+
+/* How many of each kind of ray traces cast, and the time spent finding
+   what they hit.
+*/
+struct ray_profile {
+  ray_profile() {
+    for (unsigned kind = 0u; kind < RAY_KIND_COUNT; ++kind) {
+      counts[kind] = 0u;
+      seconds[kind] = 0.;
+    }
+  }
+
+  void add(const ray_profile& other) {
+    for (unsigned kind = 0u; kind < RAY_KIND_COUNT; ++kind) {
+      counts[kind] += other.counts[kind];
+      seconds[kind] += other.seconds[kind];
+    }
+  }
+
+  size_t counts[RAY_KIND_COUNT];
+  double seconds[RAY_KIND_COUNT];
+};
+
+/* The state a rendering thread reuses from one cast to the next.
+*/
+struct trace_context {
+  trace_context()
+    : gather_points(0)
+    , irradiance_records(0)
+    , profile(0)
+    , pixel(0u)
+  {
+  }
+
+  ray_stack stack;
+  sampler rng;
+  std::vector<kd_neighbor<photon_hit>> photon_neighbors;
+  // for progressive photon mapping, where to record the points that would
+  // gather photons, and the pixel they belong to
+  std::vector<gather_point>* gather_points;
+  // for the irradiance cache prepass, where to record indirect light
+  std::vector<irradiance_record>* irradiance_records;
+  // if set, where the rays cast are counted and timed
+  ray_profile* profile;
+  unsigned pixel;
+};
+
+vec3f cast_ray(const ray_t& ray, const scene_t& s, vec3f background,
+  trace_context& ctx);
+
+/* The seconds that profiling adds to the time of each ray, which should
+   be taken off the times it measures.
+*/
+double ray_timing_overhead();
+
+#endif
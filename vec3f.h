@@ -1,6 +1,7 @@
 #ifndef VEC3F_H
 #define VEC3F_H
 
+#include <algorithm>
 #include <array>
 #include "vector_math.h"
 
@@ -125,6 +126,10 @@ inline vec3f cross(const vec3f& x, const vec3f& y) {
   return result;
 }
 
+inline float max_component(const vec3f& x) {
+  return std::max({ x[0], x[1], x[2] });
+}
+
 inline vec3f nextafter(const vec3f& x, const vec3f& y) {
   return vec3f(std::nextafter(x[0], y[0]),
     std::nextafter(x[1], y[1]),